@@ -0,0 +1,63 @@
+# Times the extension's entry points from Ruby, to show what calling through FFI costs.
+#
+#   ruby bench/ffi.rb [pebench.json] [scale] > ffi.json
+#
+# Each entry point is called on spots dealt from a fixed seed, like those of pebench. Given the
+# JSON written by pebench (see ext/poker-eval-api/tools/pebench.c), the native time of the same
+# call is subtracted to give the overhead per call. Results are written to stdout as JSON.
+require 'json'
+require_relative '../lib/pokereval'
+
+native = {}
+if ARGV[0]
+	JSON.parse(File.read(ARGV[0]))['benchmarks'].each {|b| native[b['name']] = b['ns_per_call']['mean'] }
+end
+scale = (ARGV[1] || 1).to_i
+
+pe = PokerEval.new
+rng = Random.new(1)
+deal = lambda do |nboard|
+	cards = (0..51).to_a.sample(2 + nboard, random: rng)
+	[PokerEvalAPI.cards_to_mask(cards[0, 2]), PokerEvalAPI.cards_to_mask(cards[2..-1])]
+end
+spots = lambda {|nboard| Array.new(256) { deal.call(nboard) } }
+flop, turn, river = spots.call(3), spots.call(4), spots.call(5)
+hands7 = river.map {|p, b| pe.join_cards(p, b) }
+strs7 = hands7.map(&:to_s)
+flop_strs = flop.map {|p, b| [p.to_s, b.to_s] }
+river_strs = river.map {|p, b| [p.to_s, b.to_s] }
+buf = FFI::MemoryPointer.new(:uint32, PokerEvalAPI::N_COMBOS)
+count = proc {|score, cards| }
+
+# name, the pebench benchmark timing the same native call, calls, and the call on spot i
+benches = [
+	['null_call', nil, 200_000, lambda {|i| PokerEvalAPI.wrap_StdDeck_numCards(hands7[i]) }],
+	['eval_n_7', 'eval_n_7', 200_000, lambda {|i| PokerEvalAPI.StdDeck_StdRules_EVAL_N(hands7[i], 7) }],
+	['eval_type_7', 'eval_type_7', 200_000, lambda {|i| PokerEvalAPI.StdDeck_StdRules_EVAL_TYPE(hands7[i], 7) }],
+	['eval_mask_n', 'eval_n_7', 200_000, lambda {|i| PokerEvalAPI.Eval_Mask_N(hands7[i]) }],
+	['eval_str_n', 'eval_n_7', 200_000, lambda {|i| PokerEvalAPI.Eval_Str_N(strs7[i]) }],
+	['score_hand', 'eval_n_7', 50_000, lambda {|i| pe.score_hand(*river_strs[i]) }],
+	['hand_strength_flop', 'hand_strength_flop', 2_000, lambda {|i| PokerEvalAPI.handStrength(*flop[i]) }],
+	['PokerEval#hand_strength', 'hand_strength_flop', 2_000, lambda {|i| pe.hand_strength(*flop_strs[i]) }],
+	['hand_potential_turn_1', 'hand_potential_turn_1', 100, lambda {|i| PokerEvalAPI.handPotentialMask(*turn[i], 7) }],
+	['score_two_cards_flop', 'score_two_cards_flop', 200, lambda {|i| PokerEvalAPI.scoreTwoCardsMask(*flop[i], count) }],
+	['score_two_cards_into_flop', 'score_two_cards_into_flop', 2_000, lambda {|i| PokerEvalAPI.scoreTwoCardsInto(*flop[i], buf) }],
+	['eval_outs_turn_river', 'eval_outs_turn_river', 2_000, lambda {|i| PokerEvalAPI.evalOutsMask(*turn[i], 5, count) }]
+]
+
+results = benches.map do |name, native_name, calls, call|
+	calls *= scale
+	call.call(0)
+	t0 = Process.clock_gettime(Process::CLOCK_MONOTONIC, :nanosecond)
+	calls.times {|i| call.call(i & 255) }
+	ns = (Process.clock_gettime(Process::CLOCK_MONOTONIC, :nanosecond) - t0).to_f / calls
+	res = { name: name, calls: calls, ns_per_call: ns.round(1) }
+	if native[native_name]
+		res[:native] = native_name
+		res[:overhead_ns] = (ns - native[native_name]).round(1)
+	end
+	$stderr.puts format('%-28s %12.1f ns/call', name, ns)
+	res
+end
+
+puts JSON.pretty_generate(ruby: RUBY_VERSION, ffi: FFI::VERSION, benchmarks: results)
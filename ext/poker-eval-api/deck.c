@@ -0,0 +1,85 @@
+#include "poker-eval/poker_defs.h"
+#include "poker-eval-api.h"
+#include <stdlib.h>
+
+/*
+ * A deck to deal random cards from, for simulations written outside the
+ * extension.  The live cards are kept in an array, and a layout of sets is
+ * dealt by a partial Fisher-Yates shuffle: each card is drawn from the
+ * cards not yet dealt, and swapped to the front of them.  The array stays
+ * a permutation of the live cards, so the next layout starts over from it
+ * with nothing to undo, and no card is ever drawn and thrown back.
+ */
+
+struct PokerDeck {
+	int live[StdDeck_N_CARDS];
+	int nlive;
+	PokerRand rng;
+};
+
+/* Returns a deck of the cards not in dead, or NULL if out of memory */
+PokerDeck *deckNew(StdDeck_CardMask dead, uint64 seed) {
+	PokerDeck *deck = malloc(sizeof *deck);
+
+	if (deck == NULL)
+		return NULL;
+	deckSetDead(deck, dead);
+	pokerRandSeed(&deck->rng, seed);
+	return deck;
+}
+
+void deckFree(PokerDeck *deck) {
+	free(deck);
+}
+
+void deckSeed(PokerDeck *deck, uint64 seed) {
+	pokerRandSeed(&deck->rng, seed);
+}
+
+/* Puts every card back but those in dead */
+void deckSetDead(PokerDeck *deck, StdDeck_CardMask dead) {
+	int i;
+
+	deck->nlive = 0;
+	for (i = 0; i < StdDeck_N_CARDS; i++)
+		if (!StdDeck_CardMask_CARD_IS_SET(dead, i))
+			deck->live[deck->nlive++] = i;
+}
+
+int deckLiveCount(const PokerDeck *deck) {
+	return deck->nlive;
+}
+
+/*
+ * Deals iterations layouts of nsets sets, of sizes[set] cards each, every
+ * layout from all the live cards.  out takes the cards_n mask of each set,
+ * nsets to a layout.  Returns iterations, or -1 if a layout takes more
+ * cards than are live.
+ */
+int deckDeal(PokerDeck *deck, const int *sizes, int nsets, uint64 *out, int iterations) {
+	int need = 0, set, i, j, k, t, it;
+	uint64 m;
+
+	for (set = 0; set < nsets; set++) {
+		if (sizes[set] < 0)
+			return -1;
+		need += sizes[set];
+	}
+	if (need > deck->nlive)
+		return -1;
+
+	for (it = 0; it < iterations; it++) {
+		for (set = 0, k = 0; set < nsets; set++) {
+			m = 0;
+			for (i = 0; i < sizes[set]; i++, k++) {
+				j = k + pokerRandBelow(&deck->rng, deck->nlive - k);
+				t = deck->live[j];
+				deck->live[j] = deck->live[k];
+				deck->live[k] = t;
+				m |= StdDeck_MASK(t).cards_n;
+			}
+			*out++ = m;
+		}
+	}
+	return iterations;
+}
@@ -0,0 +1,177 @@
+#include "poker-eval/poker_defs.h"
+#include "poker-eval-api.h"
+
+extern uint8 nBitsAndStrTable[StdDeck_N_RANKMASKS];
+
+/*
+ * StdDeck_StdRules_EVAL_N and StdDeck_StdRules_EVAL_TYPE for hands of 5, 6
+ * and 7 cards.  The enumerations always know how many cards they evaluate,
+ * so they pick one of these once, with evalNSized or evalTypeSized, rather
+ * than passing the count to every call.
+ *
+ * The bodies below are written once and expanded for each size with
+ * n_cards a constant, so each copy keeps only the cases that size allows.
+ * With at most 7 cards, five or more ranks leave at most two duplicates,
+ * so a straight or flush can never be beaten by a full house or quads and
+ * is returned as soon as it is found (the hand type carries a straight on
+ * to the switch, where picking it takes a select rather than a branch);
+ * with 5 cards, five ranks and neither is no pair.  nBitsAndStrTable
+ * gives the rank count and whether there is a straight in one lookup, and
+ * ORed over the suits, whether there is a flush or straight flush at all,
+ * so the suit holding it is only looked for when there is one.
+ */
+
+#define SIZED_INLINE static inline __attribute__((always_inline))
+
+SIZED_INLINE HandVal evalSizedN(StdDeck_CardMask cards, const int n_cards) {
+	uint32 ss, sc, sd, sh, ranks, rbits, fbits, suit, two_mask, three_mask, four_mask, t;
+	int n_dups, tc, second;
+
+	ss = StdDeck_CardMask_SPADES(cards);
+	sc = StdDeck_CardMask_CLUBS(cards);
+	sd = StdDeck_CardMask_DIAMONDS(cards);
+	sh = StdDeck_CardMask_HEARTS(cards);
+	ranks = ss | sc | sd | sh;
+	rbits = nBitsAndStrTable[ranks];
+	n_dups = n_cards - (int) (rbits >> 2);
+
+	if (rbits & 0x01) {
+		fbits = nBitsAndStrTable[ss] | nBitsAndStrTable[sc] | nBitsAndStrTable[sd] | nBitsAndStrTable[sh];
+		if (fbits & 0x01) {
+			/* only one suit can hold five of at most 7 cards */
+			suit = nBitsTable[ss] >= 5 ? ss : nBitsTable[sc] >= 5 ? sc : nBitsTable[sd] >= 5 ? sd : sh;
+			if (fbits & 0x02)
+				return HandVal_HANDTYPE_VALUE(StdRules_HandType_STFLUSH)
+					+ HandVal_TOP_CARD_VALUE(straightTable[suit]);
+			return HandVal_HANDTYPE_VALUE(StdRules_HandType_FLUSH) + topFiveCardsTable[suit];
+		}
+		if (rbits & 0x02)
+			return HandVal_HANDTYPE_VALUE(StdRules_HandType_STRAIGHT)
+				+ HandVal_TOP_CARD_VALUE(straightTable[ranks]);
+		if (n_cards == 5)
+			return HandVal_HANDTYPE_VALUE(StdRules_HandType_NOPAIR) + topFiveCardsTable[ranks];
+	}
+
+	switch (n_dups) {
+	case 0:
+		return HandVal_HANDTYPE_VALUE(StdRules_HandType_NOPAIR) + topFiveCardsTable[ranks];
+
+	case 1:
+		two_mask = ranks ^ (sc ^ sd ^ sh ^ ss);
+		t = ranks ^ two_mask;
+		return HandVal_HANDTYPE_VALUE(StdRules_HandType_ONEPAIR)
+			+ HandVal_TOP_CARD_VALUE(topCardTable[two_mask])
+			+ ((topFiveCardsTable[t] >> HandVal_CARD_WIDTH) & ~HandVal_FIFTH_CARD_MASK);
+
+	case 2:
+		two_mask = ranks ^ (sc ^ sd ^ sh ^ ss);
+		if (two_mask)
+			return HandVal_HANDTYPE_VALUE(StdRules_HandType_TWOPAIR)
+				+ (topFiveCardsTable[two_mask] & (HandVal_TOP_CARD_MASK | HandVal_SECOND_CARD_MASK))
+				+ HandVal_THIRD_CARD_VALUE(topCardTable[ranks ^ two_mask]);
+		three_mask = ((sc & sd) | (sh & ss)) & ((sc & sh) | (sd & ss));
+		t = ranks ^ three_mask;
+		second = topCardTable[t];
+		return HandVal_HANDTYPE_VALUE(StdRules_HandType_TRIPS)
+			+ HandVal_TOP_CARD_VALUE(topCardTable[three_mask])
+			+ HandVal_SECOND_CARD_VALUE(second)
+			+ HandVal_THIRD_CARD_VALUE(topCardTable[t ^ (1 << second)]);
+
+	default:
+		/* quads, a full house or, from 6 cards, three pairs */
+		four_mask = sh & sd & sc & ss;
+		if (four_mask) {
+			tc = topCardTable[four_mask];
+			return HandVal_HANDTYPE_VALUE(StdRules_HandType_QUADS)
+				+ HandVal_TOP_CARD_VALUE(tc)
+				+ HandVal_SECOND_CARD_VALUE(topCardTable[ranks ^ (1 << tc)]);
+		}
+		two_mask = ranks ^ (sc ^ sd ^ sh ^ ss);
+		if (n_cards == 5 || nBitsTable[two_mask] != (uint32) n_dups) {
+			three_mask = ((sc & sd) | (sh & ss)) & ((sc & sh) | (sd & ss));
+			tc = topCardTable[three_mask];
+			return HandVal_HANDTYPE_VALUE(StdRules_HandType_FULLHOUSE)
+				+ HandVal_TOP_CARD_VALUE(tc)
+				+ HandVal_SECOND_CARD_VALUE(topCardTable[(two_mask | three_mask) ^ (1 << tc)]);
+		}
+		tc = topCardTable[two_mask];
+		second = topCardTable[two_mask ^ (1 << tc)];
+		return HandVal_HANDTYPE_VALUE(StdRules_HandType_TWOPAIR)
+			+ HandVal_TOP_CARD_VALUE(tc)
+			+ HandVal_SECOND_CARD_VALUE(second)
+			+ HandVal_THIRD_CARD_VALUE(topCardTable[ranks ^ (1 << tc) ^ (1 << second)]);
+	}
+}
+
+SIZED_INLINE int evalSizedType(StdDeck_CardMask cards, const int n_cards) {
+	uint32 ss, sc, sd, sh, ranks, rbits, fbits;
+	int n_dups, st_or_fl = 0;
+
+	ss = StdDeck_CardMask_SPADES(cards);
+	sc = StdDeck_CardMask_CLUBS(cards);
+	sd = StdDeck_CardMask_DIAMONDS(cards);
+	sh = StdDeck_CardMask_HEARTS(cards);
+	ranks = ss | sc | sd | sh;
+	rbits = nBitsAndStrTable[ranks];
+	n_dups = n_cards - (int) (rbits >> 2);
+
+	if (rbits & 0x01) {
+		fbits = nBitsAndStrTable[ss] | nBitsAndStrTable[sc] | nBitsAndStrTable[sd] | nBitsAndStrTable[sh];
+		if (fbits & 0x01)
+			return (fbits & 0x02) ? StdRules_HandType_STFLUSH : StdRules_HandType_FLUSH;
+		if (rbits & 0x02)
+			st_or_fl = StdRules_HandType_STRAIGHT;
+	}
+
+	switch (n_dups) {
+	case 0:
+		return st_or_fl ? st_or_fl : StdRules_HandType_NOPAIR;
+	case 1:
+		return st_or_fl ? st_or_fl : StdRules_HandType_ONEPAIR;
+	case 2:
+		if (st_or_fl)
+			return st_or_fl;
+		return (ranks ^ (sc ^ sd ^ sh ^ ss)) ? StdRules_HandType_TWOPAIR : StdRules_HandType_TRIPS;
+	default:
+		if (sc & sd & sh & ss)
+			return StdRules_HandType_QUADS;
+		if (n_cards == 5 || (((sc & sd) | (sh & ss)) & ((sc & sh) | (sd & ss))))
+			return StdRules_HandType_FULLHOUSE;
+		return StdRules_HandType_TWOPAIR;
+	}
+}
+
+#define EVAL_SIZED(n) \
+	HandVal evalN##n(StdDeck_CardMask cards) { return evalSizedN(cards, n); } \
+	int evalType##n(StdDeck_CardMask cards) { return evalSizedType(cards, n); }
+
+EVAL_SIZED(5)
+EVAL_SIZED(6)
+EVAL_SIZED(7)
+
+/* The evaluator specialized for n_cards, or NULL if there is none */
+EvalNFn evalNSized(int n_cards) {
+	switch (n_cards) {
+	case 5:
+		return evalN5;
+	case 6:
+		return evalN6;
+	case 7:
+		return evalN7;
+	default:
+		return NULL;
+	}
+}
+
+EvalTypeFn evalTypeSized(int n_cards) {
+	switch (n_cards) {
+	case 5:
+		return evalType5;
+	case 6:
+		return evalType6;
+	case 7:
+		return evalType7;
+	default:
+		return NULL;
+	}
+}
@@ -0,0 +1,109 @@
+#include "poker-eval/poker_defs.h"
+#include "poker-eval-api.h"
+#include <fcntl.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+/*
+ * The lookup table is mapped read-only and shared, so every process using
+ * the same file shares one copy in the page cache.  Once loaded, a table
+ * stays mapped for the life of the process, even if another is loaded
+ * after it, as enumerations running on other threads may still be reading
+ * it.
+ */
+
+static const EvalTable *eval_table_loaded = NULL;
+static int table_eval = 1;
+
+/* Compares the table against the evaluator it replaces on a spread of
+ * random hands */
+static int evalTableCheck(const EvalTable *t) {
+	PokerRand rand;
+	StdDeck_CardMask cards;
+	int i, n;
+
+	pokerRandSeed(&rand, 0);
+	for (i = 0; i < 20000; i++) {
+		n = 1 + i % EVALTAB_MAX_CARDS;
+		StdDeck_CardMask_RESET(cards);
+		while (StdDeck_numCards(cards) < n)
+			StdDeck_CardMask_SET(cards, pokerRandBelow(&rand, StdDeck_N_CARDS));
+		if (evalTableN(t, cards, n) != StdDeck_StdRules_EVAL_N(cards, n))
+			return 0;
+	}
+	return 1;
+}
+
+/*
+ * Maps the table at path.  Returns 1 on success, or 0 if the file can't be
+ * read, isn't a table or gives values that differ from StdDeck_StdRules_EVAL_N.
+ */
+int evalTableLoad(const char *path) {
+	const EvalTableHeader *h;
+	const uint32 *p;
+	struct stat st;
+	EvalTable t, *loaded;
+	size_t size;
+	uint32 row;
+	void *map;
+	int fd;
+
+	fd = open(path, O_RDONLY);
+	if (fd < 0)
+		return 0;
+	if (fstat(fd, &st) != 0 || st.st_size < (off_t) sizeof(EvalTableHeader)) {
+		close(fd);
+		return 0;
+	}
+	size = st.st_size;
+	map = mmap(NULL, size, PROT_READ, MAP_SHARED, fd, 0);
+	close(fd);
+	if (map == MAP_FAILED)
+		return 0;
+
+	h = map;
+	if (memcmp(h->magic, EVALTAB_MAGIC, sizeof h->magic) != 0 || h->rowshift == 0 || h->rowshift >= 32
+			|| size != sizeof(EvalTableHeader) + sizeof(uint32) * ((size_t) StdDeck_N_RANKMASKS * 2 + h->nrows + h->nranks)) {
+		munmap(map, size);
+		return 0;
+	}
+	p = (const uint32 *) (h + 1);
+	t.suitkey = p;
+	t.disp = p + StdDeck_N_RANKMASKS;
+	t.ranks = t.disp + h->nrows;
+	t.flush = t.ranks + h->nranks;
+	t.rowshift = h->rowshift;
+	t.rowmask = (1u << h->rowshift) - 1;
+
+	for (row = 0; row < h->nrows; row++)
+		if (h->nranks <= t.rowmask || t.disp[row] > h->nranks - 1 - t.rowmask)
+			break;
+	if (row < h->nrows || !evalTableCheck(&t) || (loaded = malloc(sizeof t)) == NULL) {
+		munmap(map, size);
+		return 0;
+	}
+	*loaded = t;
+	eval_table_loaded = loaded;
+	return 1;
+}
+
+int evalTableLoaded(void) {
+	return eval_table_loaded != NULL;
+}
+
+void setTableEval(int on) {
+	table_eval = on;
+}
+
+int getTableEval(void) {
+	return table_eval;
+}
+
+/* The table the enumerations should evaluate with, or NULL to use
+ * StdDeck_StdRules_EVAL_N */
+const EvalTable *evalTable(void) {
+	return table_eval ? eval_table_loaded : NULL;
+}
@@ -7,4 +7,89 @@ end
 $LDFLAGS << " -Wl,-R/usr/local/lib -lpoker-eval -L/usr/local/lib"
 $CFLAGS << " -I/usr/include/poker-eval -I/usr/local/include/poker-eval -fPIC -L/usr/local/lib"
 have_library "poker-eval"
+have_library "pthread"
+$cleanfiles << "mkevaltab" << "handval.tab" << "mkpreflop" << "pebulk" << "pebench" << "bench.json"
+$distcleanfiles << "preflop.tab"
+preflop = enable_config("preflop-table", false)
+# Instrumentation counters, read by PokerEval#stats; without them the hooks compile to nothing
+$CFLAGS << " -DPOKEREVAL_STATS" if enable_config("stats", false)
+# Profile guided optimization, trained on the benchmarks; see the pgo rules below
+pgo = enable_config("pgo", false)
+PGO_USE = "-fprofile-use -fprofile-correction -Wno-missing-profile"
+$CFLAGS << " " << PGO_USE if pgo
+$cleanfiles << "pgo.stamp" << "*.gcda" if pgo
 create_makefile('poker-eval-api/poker-eval-api')
+
+# Generate the lookup table evaluator's table along with the extension
+File.open("Makefile", "a") do |mf|
+	mf.puts <<'MAKE'
+
+EVALTAB = handval.tab
+
+all: $(EVALTAB)
+
+mkevaltab: $(srcdir)/tools/mkevaltab.c $(OBJS)
+	$(ECHO) linking $@
+	$(Q) $(CC) $(INCFLAGS) $(CPPFLAGS) $(CFLAGS) -o $@ $(srcdir)/tools/mkevaltab.c $(OBJS) $(LIBPATH) $(ldflags) $(LIBS)
+
+$(EVALTAB): mkevaltab
+	$(ECHO) generating $@
+	$(Q) ./mkevaltab $@
+
+# The bulk analysis tool, for running the evaluators over streams of spots outside Ruby
+all: pebulk
+
+pebulk: $(srcdir)/tools/pebulk.c $(OBJS)
+	$(ECHO) linking $@
+	$(Q) $(CC) $(INCFLAGS) $(CPPFLAGS) $(CFLAGS) -o $@ $(srcdir)/tools/pebulk.c $(OBJS) $(LIBPATH) $(ldflags) $(LIBS)
+
+# "make bench" times the evaluators and enumerators, with the lookup table as the extension
+# loads it, into bench.json; see tools/pebench.c
+.PHONY: bench
+bench: pebench $(EVALTAB)
+	$(Q) ./pebench -e $(EVALTAB) -o bench.json
+
+pebench: $(srcdir)/tools/pebench.c $(OBJS)
+	$(ECHO) linking $@
+	$(Q) $(CC) $(INCFLAGS) $(CPPFLAGS) $(CFLAGS) -o $@ $(srcdir)/tools/pebench.c $(OBJS) $(LIBPATH) $(ldflags) $(LIBS)
+
+# The preflop table takes about a quarter of an hour of CPU time, so it is only built by
+# "make preflop", or along with the extension with --enable-preflop-table
+PREFLOPTAB = preflop.tab
+
+.PHONY: preflop
+preflop: $(PREFLOPTAB)
+
+mkpreflop: $(srcdir)/tools/mkpreflop.c $(OBJS)
+	$(ECHO) linking $@
+	$(Q) $(CC) $(INCFLAGS) $(CPPFLAGS) $(CFLAGS) -o $@ $(srcdir)/tools/mkpreflop.c $(OBJS) $(LIBPATH) $(ldflags) $(LIBS)
+
+$(PREFLOPTAB): mkpreflop $(EVALTAB)
+	$(ECHO) generating $@
+	$(Q) ./mkpreflop $@ $(EVALTAB)
+MAKE
+	mf.puts "\nall: $(PREFLOPTAB)" if preflop
+	mf.puts <<MAKE if pgo
+
+# With --enable-pgo the sources are first built instrumented into pgo/, where mkevaltab and
+# pebench run as the training workload, with and without the lookup table.  The profiles they
+# leave are copied next to the objects, which are then compiled with them
+PGO_CFLAGS = $(filter-out #{PGO_USE},$(CFLAGS)) -fprofile-generate
+
+$(OBJS): pgo.stamp
+
+pgo.stamp: $(SRCS:%=$(srcdir)/%) $(srcdir)/tools/mkevaltab.c $(srcdir)/tools/pebench.c
+	$(ECHO) training the profile
+	$(Q) $(RM_RF) pgo && $(MAKEDIRS) pgo
+	$(Q) for src in $(SRCS); do \\
+		$(CC) $(INCFLAGS) $(CPPFLAGS) $(PGO_CFLAGS) -c $(srcdir)/$$src -o pgo/$${src%.c}.o || exit 1; \\
+	done
+	$(Q) for tool in mkevaltab pebench; do \\
+		$(CC) $(INCFLAGS) $(CPPFLAGS) $(PGO_CFLAGS) -o pgo/$$tool $(srcdir)/tools/$$tool.c pgo/*.o $(LIBPATH) $(ldflags) $(LIBS) || exit 1; \\
+	done
+	$(Q) pgo/mkevaltab pgo/$(EVALTAB) && pgo/pebench -o pgo/bench.json && pgo/pebench -e pgo/$(EVALTAB) -o pgo/bench.json
+	$(Q) for src in $(SRCS); do cp pgo/$${src%.c}.gcda $${src%.c}.gcda || exit 1; done
+	$(Q) $(RM_RF) pgo
+	$(Q) touch $@
+MAKE
+end
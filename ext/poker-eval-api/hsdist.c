@@ -0,0 +1,324 @@
+#include "poker-eval/poker_defs.h"
+#include "poker-eval-api.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/*
+ * Hand strength distributions.  For a pocket and a board of 3 to 5 cards,
+ * every completion of the board to the river is dealt once, and the hand
+ * strength on it (against one random hand, ties counted half) goes into a
+ * histogram and the first two moments.
+ *
+ * Rivers that only differ by relabelling suits that the pocket and board
+ * don't tell apart have the same hand strength, so one river per orbit is
+ * evaluated and weighted by the orbit's size.  On each river the opponent
+ * hands are evaluated in one block, which the SIMD evaluator takes eight at
+ * a time.  The rivers are split into a fixed number of chunks whose totals
+ * are summed in order, so results don't depend on the thread count.
+ */
+
+#define HSD_CHUNKS 64
+#define HSD_MAX_RUNOUTS (StdDeck_N_CARDS * (StdDeck_N_CARDS - 1) / 2)
+/* spots computed at once by hsFeaturesWrite */
+#define HSF_BATCH 1024
+
+typedef struct {
+	StdDeck_CardMask pocket;
+	const EvalTable *table;
+	int nbuckets;
+	StdDeck_CardMask runouts[HSD_MAX_RUNOUTS];
+	int weights[HSD_MAX_RUNOUTS];
+	int nrunouts;
+	int nchunks;
+	/* per chunk: rivers, sum of HS, sum of HS^2, then the buckets */
+	double *acc;
+} HsdJob;
+
+/* Hand strength of the pocket on a full board */
+static double hsdRiver(const HsdJob *job, StdDeck_CardMask river) {
+	StdDeck_CardMask dead, cards[N_COMBOS];
+	HandVal ours, vals[N_COMBOS];
+	int live[StdDeck_N_CARDS];
+	int i, j, n = 0, cnt = 0;
+	double ahead = 0, tied = 0;
+
+	StdDeck_CardMask_OR(dead, job->pocket, river);
+	ours = evalTableSized(job->table, evalN7, dead, 7);
+	for (i = 0; i < StdDeck_N_CARDS; i++)
+		if (!StdDeck_CardMask_CARD_IS_SET(dead, i))
+			live[n++] = i;
+	for (i = 0; i < n; i++) {
+		for (j = 0; j < i; j++) {
+			StdDeck_CardMask_OR(cards[cnt], StdDeck_MASK(live[i]), StdDeck_MASK(live[j]));
+			StdDeck_CardMask_OR(cards[cnt], cards[cnt], river);
+			cnt++;
+		}
+	}
+	evalBlock(job->table, cards, 7, vals, cnt);
+	for (i = 0; i < cnt; i++) {
+		if (vals[i] < ours)
+			ahead++;
+		else if (vals[i] == ours)
+			tied++;
+	}
+	return (ahead + tied / 2) / cnt;
+}
+
+static void hsdChunk(void *arg, int chunk) {
+	HsdJob *job = arg;
+	double *acc = job->acc + chunk * (3 + job->nbuckets);
+	int lo = chunk * job->nrunouts / job->nchunks;
+	int hi = (chunk + 1) * job->nrunouts / job->nchunks;
+	int r, b;
+	double hs, w;
+
+	for (r = lo; r < hi; r++) {
+		hs = hsdRiver(job, job->runouts[r]);
+		w = job->weights[r];
+		b = (int) (hs * job->nbuckets);
+		if (b >= job->nbuckets)
+			b = job->nbuckets - 1;
+		acc[0] += w;
+		acc[1] += w * hs;
+		acc[2] += w * hs * hs;
+		acc[3 + b] += w;
+	}
+}
+
+/* hsDistribution, on the worker pool if parallel, or else on this thread */
+static HsDistribution hsdCompute(StdDeck_CardMask pocket, StdDeck_CardMask board, int nbuckets, double *hist, int parallel) {
+	HsDistribution res = { -1, -1, -1 };
+	HsdJob *job;
+	SuitGroup group;
+	StdDeck_CardMask dead;
+	double total[3] = { 0, 0, 0 };
+	int live[StdDeck_N_CARDS];
+	int cards[2];
+	int nboard, nlive = 0, c, i, j, w, chunk;
+
+	nboard = StdDeck_numCards(board);
+	if (nbuckets < 1 || StdDeck_numCards(pocket) != 2 || StdDeck_CardMask_ANY_SET(pocket, board)
+			|| nboard < 3 || nboard > 5)
+		return res;
+	job = malloc(sizeof *job);
+	if (job == NULL)
+		return res;
+
+	StdDeck_CardMask_OR(dead, pocket, board);
+	for (c = 0; c < StdDeck_N_CARDS; c++)
+		if (!StdDeck_CardMask_CARD_IS_SET(dead, c))
+			live[nlive++] = c;
+	suitGroupFixing(&group, pocket, board);
+	job->pocket = pocket;
+	job->table = evalTable();
+	job->nbuckets = nbuckets;
+	job->nrunouts = 0;
+	if (nboard == 5) {
+		job->runouts[0] = board;
+		job->weights[0] = 1;
+		job->nrunouts = 1;
+	}
+	for (i = nlive - 1; i >= 0 && nboard == 4; i--) {
+		cards[0] = live[i];
+		w = suitOrbitWeight(&group, cards, 1);
+		if (w == 0)
+			continue;
+		StdDeck_CardMask_OR(job->runouts[job->nrunouts], board, StdDeck_MASK(live[i]));
+		job->weights[job->nrunouts++] = w;
+	}
+	for (i = nlive - 1; i >= 0 && nboard == 3; i--) {
+		for (j = i - 1; j >= 0; j--) {
+			w = suitOrbitWeight2(&group, live[i], live[j]);
+			if (w == 0)
+				continue;
+			StdDeck_CardMask_OR(job->runouts[job->nrunouts], board, StdDeck_MASK(live[i]));
+			StdDeck_CardMask_OR(job->runouts[job->nrunouts], job->runouts[job->nrunouts], StdDeck_MASK(live[j]));
+			job->weights[job->nrunouts++] = w;
+		}
+	}
+	job->nchunks = job->nrunouts < HSD_CHUNKS ? job->nrunouts : HSD_CHUNKS;
+	job->acc = calloc(job->nchunks * (3 + nbuckets), sizeof *job->acc);
+	if (job->acc == NULL) {
+		free(job);
+		return res;
+	}
+
+	if (parallel && getThreadCount() > 1)
+		poolRun(hsdChunk, job, job->nchunks);
+	else
+		for (chunk = 0; chunk < job->nchunks; chunk++)
+			hsdChunk(job, chunk);
+
+	for (i = 0; i < nbuckets; i++)
+		hist[i] = 0;
+	for (chunk = 0; chunk < job->nchunks; chunk++) {
+		double *acc = job->acc + chunk * (3 + nbuckets);
+
+		for (i = 0; i < 3; i++)
+			total[i] += acc[i];
+		for (i = 0; i < nbuckets; i++)
+			hist[i] += acc[3 + i];
+	}
+	for (i = 0; i < nbuckets; i++)
+		hist[i] /= total[0];
+	res.ehs = total[1] / total[0];
+	res.ehs2 = total[2] / total[0];
+	res.runouts = (int) total[0];
+	free(job->acc);
+	free(job);
+	return res;
+}
+
+/*
+ * The distribution of hand strength over every river that completes board,
+ * of 3 to 5 cards.  hist receives the fraction of rivers with hand strength
+ * in each of nbuckets equal buckets, and the result E[HS], E[HS^2] and the
+ * number of rivers.  All fields are -1 for unsupported spots.
+ */
+HsDistribution hsDistribution(StdDeck_CardMask pocket, StdDeck_CardMask board, int nbuckets, double *hist) {
+	return hsdCompute(pocket, board, nbuckets, hist, 1);
+}
+
+typedef struct {
+	StdDeck_CardMask pocket;
+	StdDeck_CardMask boards[HSF_BATCH];
+	int nbuckets;
+	size_t recsize;
+	unsigned char *out;
+	/* set by any spot that couldn't be computed */
+	int failed;
+} HsfBatch;
+
+static void hsfSpot(void *arg, int item) {
+	HsfBatch *batch = arg;
+	unsigned char *rec = batch->out + item * batch->recsize;
+	double *hist = malloc(batch->nbuckets * sizeof *hist);
+	HsDistribution d;
+	float f;
+	int b;
+
+	if (hist == NULL) {
+		__atomic_store_n(&batch->failed, 1, __ATOMIC_RELAXED);
+		return;
+	}
+	d = hsdCompute(batch->pocket, batch->boards[item], batch->nbuckets, hist, 0);
+	if (d.runouts < 0)
+		__atomic_store_n(&batch->failed, 1, __ATOMIC_RELAXED);
+	memcpy(rec, &batch->pocket.cards_n, 8);
+	memcpy(rec + 8, &batch->boards[item].cards_n, 8);
+	f = (float) d.ehs;
+	memcpy(rec + 16, &f, 4);
+	f = (float) d.ehs2;
+	memcpy(rec + 20, &f, 4);
+	for (b = 0; b < batch->nbuckets; b++) {
+		f = (float) hist[b];
+		memcpy(rec + 24 + 4 * b, &f, 4);
+	}
+	free(hist);
+}
+
+/* Computes the batch's n spots and writes them, unless one of them failed */
+static int hsfFlush(HsfBatch *batch, int n, FILE *fp) {
+	int i;
+
+	batch->failed = 0;
+	if (getThreadCount() > 1)
+		poolRun(hsfSpot, batch, n);
+	else
+		for (i = 0; i < n; i++)
+			hsfSpot(batch, i);
+	if (batch->failed)
+		return 0;
+	return fwrite(batch->out, batch->recsize, n, fp) == (size_t) n;
+}
+
+/*
+ * Writes the hand strength features of every spot with nboard board cards
+ * (3 for the flop or 4 for the turn), one per suit isomorphism class, to
+ * path.  Spots are spread over the worker pool and written in order of
+ * pocket then board.  Returns the number of spots, or -1 on failure, when
+ * no file is left behind.
+ */
+long hsFeaturesWrite(const char *path, int nboard, int nbuckets) {
+	HsFeatureHeader hdr;
+	HsfBatch *batch;
+	StdDeck_CardMask pocket, board;
+	FILE *fp;
+	int live[StdDeck_N_CARDS];
+	int idx[5];
+	int c1, c2, c, k, nlive, n, ok = 1;
+	long nspots = 0;
+
+	if (nboard < 3 || nboard > 4 || nbuckets < 1)
+		return -1;
+	fp = fopen(path, "wb");
+	if (fp == NULL)
+		return -1;
+	batch = malloc(sizeof *batch);
+	if (batch)
+		batch->out = malloc(HSF_BATCH * (24 + 4 * (size_t) nbuckets));
+	if (batch == NULL || batch->out == NULL) {
+		free(batch);
+		fclose(fp);
+		remove(path);
+		return -1;
+	}
+	batch->nbuckets = nbuckets;
+	batch->recsize = 24 + 4 * (size_t) nbuckets;
+	memset(&hdr, 0, sizeof hdr);
+	memcpy(hdr.magic, HSFEAT_MAGIC, 8);
+	hdr.nboard = nboard;
+	hdr.nbuckets = nbuckets;
+	ok = fwrite(&hdr, sizeof hdr, 1, fp) == 1;
+
+	StdDeck_CardMask_RESET(board);
+	for (c1 = 1; c1 < StdDeck_N_CARDS && ok; c1++) {
+		for (c2 = 0; c2 < c1 && ok; c2++) {
+			StdDeck_CardMask_OR(pocket, StdDeck_MASK(c1), StdDeck_MASK(c2));
+			if (!spotCanonical(pocket, board))
+				continue;
+			batch->pocket = pocket;
+			for (c = 0, nlive = 0; c < StdDeck_N_CARDS; c++)
+				if (c != c1 && c != c2)
+					live[nlive++] = c;
+			for (k = 0; k < nboard; k++)
+				idx[k] = k;
+			n = 0;
+			for (;;) {
+				StdDeck_CardMask_RESET(batch->boards[n]);
+				for (k = 0; k < nboard; k++)
+					StdDeck_CardMask_OR(batch->boards[n], batch->boards[n], StdDeck_MASK(live[idx[k]]));
+				if (spotCanonical(pocket, batch->boards[n]))
+					n++;
+				if (n == HSF_BATCH) {
+					ok = ok && hsfFlush(batch, n, fp);
+					nspots += n;
+					n = 0;
+				}
+				for (k = nboard - 1; k >= 0 && idx[k] == nlive - nboard + k; k--)
+					;
+				if (k < 0)
+					break;
+				idx[k]++;
+				for (k++; k < nboard; k++)
+					idx[k] = idx[k - 1] + 1;
+			}
+			if (n > 0) {
+				ok = ok && hsfFlush(batch, n, fp);
+				nspots += n;
+			}
+		}
+	}
+
+	hdr.nspots = nspots;
+	ok = ok && fseek(fp, 0, SEEK_SET) == 0 && fwrite(&hdr, sizeof hdr, 1, fp) == 1;
+	ok = fclose(fp) == 0 && ok;
+	free(batch->out);
+	free(batch);
+	if (!ok) {
+		remove(path);
+		return -1;
+	}
+	return nspots;
+}
@@ -0,0 +1,289 @@
+#include "poker-eval/poker_defs.h"
+#include "poker-eval-api.h"
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+/*
+ * Background jobs.  A job's work is split into chunks, which a job thread
+ * runs on the worker pool like any other enumeration.  Chunks look for a
+ * cancellation between the items of their outer loop and count the items
+ * they finish, which gives the progress.  A chunk that runs to its end is
+ * marked done, and estimates are made from the chunks done so far; the job
+ * kinds deal their items out to the chunks in turn, so that those are a
+ * fair sample of the whole.
+ *
+ * Jobs start in the order they were submitted, on up to JOB_THREADS job
+ * threads, which are started as they are needed.  Neither the threads nor
+ * the jobs they were running survive a fork: in the child, every unfinished
+ * job is left cancelled.
+ */
+
+#define JOB_THREADS 4
+
+struct EvalJob {
+	const EvalJobKind *kind;
+	void *state;
+	int nchunks;
+	long nitems;
+	/* written by the chunks, and read without job_lock */
+	long itemsdone;
+	int cancel;
+	uint8 done[JOB_MAX_CHUNKS];
+	/* under job_lock */
+	int status;
+	double result[JOB_RESULTS];
+	struct EvalJob *link;
+	struct EvalJob *active;
+};
+
+static pthread_mutex_t job_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t job_work = PTHREAD_COND_INITIALIZER;
+static pthread_cond_t job_finished;
+static pthread_once_t job_once = PTHREAD_ONCE_INIT;
+static EvalJob *job_queue = NULL;
+/* every job that hasn't finished, for the fork handler */
+static EvalJob *job_active = NULL;
+static int job_nthreads = 0;
+static int job_idle = 0;
+
+/* Called with job_lock held */
+static void jobFinish(EvalJob *job, int status) {
+	EvalJob **link;
+
+	for (link = &job_active; *link != job; link = &(*link)->active)
+		;
+	*link = job->active;
+	job->status = status;
+	pthread_cond_broadcast(&job_finished);
+}
+
+static void jobChunk(void *arg, int chunk) {
+	EvalJob *job = arg;
+
+	if (jobCancelled(job))
+		return;
+	if (job->kind->chunk(job->state, job, chunk))
+		__atomic_store_n(&job->done[chunk], 1, __ATOMIC_RELEASE);
+}
+
+static void *jobThread(void *unused) {
+	EvalJob *job;
+	int chunk, ndone;
+
+	pthread_mutex_lock(&job_lock);
+	for (;;) {
+		job_idle++;
+		while (job_queue == NULL)
+			pthread_cond_wait(&job_work, &job_lock);
+		job_idle--;
+		job = job_queue;
+		job_queue = job->link;
+		job->status = JOB_RUNNING;
+		pthread_mutex_unlock(&job_lock);
+
+		if (getThreadCount() > 1)
+			poolRun(jobChunk, job, job->nchunks);
+		else
+			for (chunk = 0; chunk < job->nchunks; chunk++)
+				jobChunk(job, chunk);
+		for (chunk = 0, ndone = 0; chunk < job->nchunks; chunk++)
+			ndone += job->done[chunk];
+		if (ndone == job->nchunks) {
+			job->kind->estimate(job->state, job->done, job->result);
+			if (job->kind->finish)
+				job->kind->finish(job->state, job->result);
+		}
+
+		pthread_mutex_lock(&job_lock);
+		jobFinish(job, ndone == job->nchunks ? JOB_DONE : JOB_CANCELLED);
+	}
+	return NULL;
+}
+
+/* jobWait's timeouts are on the monotonic clock */
+static void jobCondInit(void) {
+	pthread_condattr_t attr;
+
+	pthread_condattr_init(&attr);
+	pthread_condattr_setclock(&attr, CLOCK_MONOTONIC);
+	pthread_cond_init(&job_finished, &attr);
+	pthread_condattr_destroy(&attr);
+}
+
+static void jobAtforkChild(void) {
+	EvalJob *job;
+
+	pthread_mutex_init(&job_lock, NULL);
+	pthread_cond_init(&job_work, NULL);
+	jobCondInit();
+	for (job = job_active; job != NULL; job = job->active)
+		job->status = JOB_CANCELLED;
+	job_active = NULL;
+	job_queue = NULL;
+	job_nthreads = 0;
+	job_idle = 0;
+}
+
+static void jobInit(void) {
+	jobCondInit();
+	pthread_atfork(NULL, NULL, jobAtforkChild);
+}
+
+/*
+ * Queues a job of nchunks chunks, covering nitems items, over state, which
+ * the job then owns.  A job of no chunks has its result already, and is
+ * done at once.  Returns the job, or NULL (with state released) if out of
+ * memory.
+ */
+EvalJob *jobSubmit(const EvalJobKind *kind, void *state, int nchunks, long nitems) {
+	EvalJob *job = calloc(1, sizeof *job);
+	EvalJob **link;
+	pthread_t thread;
+	int i;
+
+	pthread_once(&job_once, jobInit);
+	if (job == NULL || nchunks < 0 || nchunks > JOB_MAX_CHUNKS) {
+		free(job);
+		kind->release(state);
+		return NULL;
+	}
+	job->kind = kind;
+	job->state = state;
+	job->nchunks = nchunks;
+	job->nitems = nitems;
+	for (i = 0; i < JOB_RESULTS; i++)
+		job->result[i] = -1;
+	if (nchunks == 0) {
+		kind->estimate(state, job->done, job->result);
+		job->status = JOB_DONE;
+		return job;
+	}
+
+	pthread_mutex_lock(&job_lock);
+	job->status = JOB_QUEUED;
+	for (link = &job_queue; *link != NULL; link = &(*link)->link)
+		;
+	*link = job;
+	job->active = job_active;
+	job_active = job;
+	if (job_idle == 0 && job_nthreads < JOB_THREADS
+			&& pthread_create(&thread, NULL, jobThread, NULL) == 0) {
+		pthread_detach(thread);
+		job_nthreads++;
+	}
+	if (job_nthreads == 0) {
+		/* nothing can run it */
+		job_queue = job->link;
+		jobFinish(job, JOB_CANCELLED);
+	}
+	pthread_cond_signal(&job_work);
+	pthread_mutex_unlock(&job_lock);
+	return job;
+}
+
+/* For the chunks, to see whether to stop */
+int jobCancelled(const EvalJob *job) {
+	return __atomic_load_n(&job->cancel, __ATOMIC_RELAXED);
+}
+
+/* For the chunks, to count the items they finish */
+void jobAdvance(EvalJob *job, long items) {
+	__atomic_add_fetch(&job->itemsdone, items, __ATOMIC_RELAXED);
+}
+
+/* JOB_QUEUED, JOB_RUNNING, JOB_DONE or JOB_CANCELLED */
+int jobState(EvalJob *job) {
+	int status;
+
+	pthread_mutex_lock(&job_lock);
+	status = job->status;
+	pthread_mutex_unlock(&job_lock);
+	return status;
+}
+
+/* The fraction of the items of the outer loop finished so far */
+double jobProgress(EvalJob *job) {
+	if (job->nitems <= 0)
+		return jobState(job) == JOB_DONE;
+	return (double) __atomic_load_n(&job->itemsdone, __ATOMIC_RELAXED) / job->nitems;
+}
+
+/*
+ * Fills result[JOB_RESULTS] with the job's result once it is done, or else
+ * an estimate from the chunks done so far.  Returns the fraction of the
+ * chunks the result covers; at 0 there is no estimate yet.
+ */
+double jobEstimate(EvalJob *job, double *result) {
+	uint8 done[JOB_MAX_CHUNKS];
+	int chunk, ndone = 0;
+
+	pthread_mutex_lock(&job_lock);
+	if (job->status == JOB_DONE) {
+		memcpy(result, job->result, sizeof job->result);
+		pthread_mutex_unlock(&job_lock);
+		return 1;
+	}
+	pthread_mutex_unlock(&job_lock);
+	for (chunk = 0; chunk < job->nchunks; chunk++) {
+		done[chunk] = __atomic_load_n(&job->done[chunk], __ATOMIC_ACQUIRE);
+		ndone += done[chunk];
+	}
+	job->kind->estimate(job->state, done, result);
+	return (double) ndone / job->nchunks;
+}
+
+/* Asks the job to stop; chunks already done are kept for jobEstimate */
+void jobCancel(EvalJob *job) {
+	EvalJob **link;
+
+	__atomic_store_n(&job->cancel, 1, __ATOMIC_RELAXED);
+	pthread_mutex_lock(&job_lock);
+	if (job->status == JOB_QUEUED) {
+		for (link = &job_queue; *link != job; link = &(*link)->link)
+			;
+		*link = job->link;
+		jobFinish(job, JOB_CANCELLED);
+	}
+	pthread_mutex_unlock(&job_lock);
+}
+
+/*
+ * Waits for the job to be done or cancelled, for at most timeout_ms if that
+ * isn't negative.  Returns 1 if it has finished, or 0 on timing out.
+ */
+int jobWait(EvalJob *job, double timeout_ms) {
+	struct timespec until;
+	int finished;
+
+	clock_gettime(CLOCK_MONOTONIC, &until);
+	if (timeout_ms >= 0) {
+		until.tv_sec += (time_t) (timeout_ms / 1000);
+		until.tv_nsec += (long) ((timeout_ms - 1000.0 * (time_t) (timeout_ms / 1000)) * 1e6);
+		if (until.tv_nsec >= 1000000000) {
+			until.tv_sec++;
+			until.tv_nsec -= 1000000000;
+		}
+	}
+	pthread_mutex_lock(&job_lock);
+	while (job->status < JOB_DONE) {
+		if (timeout_ms < 0)
+			pthread_cond_wait(&job_finished, &job_lock);
+		else if (pthread_cond_timedwait(&job_finished, &job_lock, &until) != 0)
+			break;
+	}
+	finished = job->status >= JOB_DONE;
+	pthread_mutex_unlock(&job_lock);
+	return finished;
+}
+
+/* Cancels the job, waits for it to stop and frees it */
+void jobFree(EvalJob *job) {
+	if (job == NULL)
+		return;
+	jobCancel(job);
+	jobWait(job, -1);
+	job->kind->release(job->state);
+	free(job);
+}
@@ -3,8 +3,10 @@
 #include <poker_wrapper.h>
 #include "poker-eval-api.h"
 #include <assert.h>
+#include <math.h>
 #include <stdlib.h>
 #include <string.h>
+#include <time.h>
 
 extern uint8 nBitsAndStrTable[StdDeck_N_RANKMASKS];
 
@@ -210,7 +212,7 @@ void evalSingleType(StdDeck_CardMask player, StdDeck_CardMask board, int tot, vo
 	int type;
 	StdDeck_CardMask_OR(player, player, board);
 	type = StdDeck_StdRules_EVAL_TYPE(player, tot);
-	callback(type, player);
+	EVAL_STAT_CALLBACK(EVAL_STAT_EVAL_OUTS, callback(type, player));
 	return;
 }
 
@@ -220,15 +222,21 @@ void evalSingle(StdDeck_CardMask player, StdDeck_CardMask board, int tot, void *
 	StdDeck_CardMask orig_cards = player;
 	StdDeck_CardMask_OR(player, player, board);
 	score = StdDeck_StdRules_EVAL_N(player, tot);
-	callback(score, orig_cards);
+	EVAL_STAT_CALLBACK(EVAL_STAT_SCORE_TWO_CARDS, callback(score, orig_cards));
 	return;
 }
 
 HandVal Eval_Str_N (char* hand) {
-		int n_cards;
-		StdDeck_CardMask thehand = TextToPokerEval(hand);
-		n_cards = strlen(hand) / 2;
-		return StdDeck_StdRules_EVAL_N(thehand, n_cards);
+		return Eval_Mask_N(TextToPokerEval(hand));
+}
+
+/* Eval_Str_N and Eval_Str_Type for cards already in a mask */
+HandVal Eval_Mask_N(StdDeck_CardMask cards) {
+	return StdDeck_StdRules_EVAL_N(cards, maskCount(cards));
+}
+
+int Eval_Mask_Type(StdDeck_CardMask cards) {
+	return StdDeck_StdRules_EVAL_TYPE(cards, maskCount(cards));
 }
 
 HandVal Eval_Ptr (StdDeck_CardMask *cards, int n_cards) {
@@ -236,9 +244,85 @@ HandVal Eval_Ptr (StdDeck_CardMask *cards, int n_cards) {
 }
 
 int Eval_Str_Type (char* hand) {
-		StdDeck_CardMask thehand = TextToPokerEval(hand);
-		int n_cards = strlen(hand) / 2;
-		return StdDeck_StdRules_EVAL_TYPE(thehand, n_cards);
+		return Eval_Mask_Type(TextToPokerEval(hand));
+}
+
+/*
+ * The mask of n card indices, checking that each is a card and that none
+ * repeats.  Returns 1 on success, or 0 with *out left alone.
+ */
+int cardsToMask(const uint8 *cards, int n, StdDeck_CardMask *out) {
+	StdDeck_CardMask m;
+	int i;
+
+	StdDeck_CardMask_RESET(m);
+	for (i = 0; i < n; i++) {
+		if (cards[i] >= StdDeck_N_CARDS || StdDeck_CardMask_CARD_IS_SET(m, cards[i]))
+			return 0;
+		StdDeck_CardMask_OR(m, m, StdDeck_MASK(cards[i]));
+	}
+	*out = m;
+	return 1;
+}
+
+/*
+ * Batch evaluation over a caller-owned buffer of raw cards_n masks, writing
+ * one result per mask into out.  n_cards may be NULL, in which case each
+ * mask's own card count is used.
+ */
+/* Fills cards with the EVAL_X8 hands starting at masks[i], and returns
+ * the card count they share, or 0 if they differ */
+static int batchX8(const uint64 *masks, const int *n_cards, int i, StdDeck_CardMask *cards) {
+	int j, tot = 0, n;
+
+	for (j = 0; j < EVAL_X8; j++) {
+		cards[j].cards_n = masks[i + j];
+		n = n_cards ? n_cards[i + j] : StdDeck_numCards(cards[j]);
+		if (j > 0 && n != tot)
+			return 0;
+		tot = n;
+	}
+	return tot;
+}
+
+void evalBatch(const uint64 *masks, const int *n_cards, HandVal *out, int n) {
+	StdDeck_CardMask cards[EVAL_X8];
+	int i, j, tot;
+
+	for (i = 0; i + EVAL_X8 <= n; i += EVAL_X8) {
+		if ((tot = batchX8(masks, n_cards, i, cards)) != 0) {
+			evalX8(cards, tot, out + i);
+			continue;
+		}
+		for (j = 0; j < EVAL_X8; j++) {
+			cards[j].cards_n = masks[i + j];
+			out[i + j] = StdDeck_StdRules_EVAL_N(cards[j], n_cards ? n_cards[i + j] : StdDeck_numCards(cards[j]));
+		}
+	}
+	for (; i < n; i++) {
+		cards[0].cards_n = masks[i];
+		out[i] = StdDeck_StdRules_EVAL_N(cards[0], n_cards ? n_cards[i] : StdDeck_numCards(cards[0]));
+	}
+}
+
+void evalTypeBatch(const uint64 *masks, const int *n_cards, int *out, int n) {
+	StdDeck_CardMask cards[EVAL_X8];
+	int i, j, tot;
+
+	for (i = 0; i + EVAL_X8 <= n; i += EVAL_X8) {
+		if ((tot = batchX8(masks, n_cards, i, cards)) != 0) {
+			evalTypeX8(cards, tot, out + i);
+			continue;
+		}
+		for (j = 0; j < EVAL_X8; j++) {
+			cards[j].cards_n = masks[i + j];
+			out[i + j] = StdDeck_StdRules_EVAL_TYPE(cards[j], n_cards ? n_cards[i + j] : StdDeck_numCards(cards[j]));
+		}
+	}
+	for (; i < n; i++) {
+		cards[0].cards_n = masks[i];
+		out[i] = StdDeck_StdRules_EVAL_TYPE(cards[0], n_cards ? n_cards[i] : StdDeck_numCards(cards[0]));
+	}
 }
 
 void tallyScore (int tally[], int us, int them) {
@@ -260,12 +344,69 @@ void evalAndTally(StdDeck_CardMask opp, StdDeck_CardMask board, HandVal us, int
 	tallyScore(tally, us, score);
 }
 
-double handStrength(StdDeck_CardMask us, StdDeck_CardMask board) {
+/*
+ * The parallel paths split the opponent's hole cards across the worker pool
+ * by the index of the higher card.  Every slice keeps its own tallies and
+ * they are summed at the end, so the totals are exactly those of the serial
+ * enumeration.
+ *
+ * When some suit permutations fix our cards and the board, only one
+ * opponent hand per orbit is evaluated, and it is counted once for every
+ * hand in its orbit.
+ */
+typedef struct {
+	StdDeck_CardMask board;
+	StdDeck_CardMask dead;
+	HandVal ourscore;
+	int tot;
+	const SuitGroup *group;
+	const EvalTable *table;
+	EvalNFn eval;
+	int tally[StdDeck_N_CARDS][3];
+} HandStrengthSlices;
+
+static void handStrengthSlice(void *arg, int i1) {
+	HandStrengthSlices *job = arg;
+	StdDeck_CardMask opp;
+	HandVal score;
+	int i2, w;
+
+	if (StdDeck_CardMask_CARD_IS_SET(job->dead, i1))
+		return;
+	/* no orbit's representative uses a suit past the second of its class */
+	if (job->group && job->group->pos[StdDeck_SUIT(i1)] > 1)
+		return;
+	for (i2 = i1 - 1; i2 >= 0; i2--) {
+		if (StdDeck_CardMask_CARD_IS_SET(job->dead, i2))
+			continue;
+		w = 1;
+		if (job->group) {
+			w = suitOrbitWeight2(job->group, i1, i2);
+			if (w == 0)
+				continue;
+		}
+		StdDeck_CardMask_OR(opp, StdDeck_MASK(i1), StdDeck_MASK(i2));
+		StdDeck_CardMask_OR(opp, opp, job->board);
+		score = evalTableSized(job->table, job->eval, opp, job->tot);
+		EVAL_STAT_ADD(EVAL_STAT_HAND_STRENGTH, evals, 1);
+		if (job->ourscore > score)
+			job->tally[i1][2] += w;
+		else if (job->ourscore < score)
+			job->tally[i1][0] += w;
+		else
+			job->tally[i1][1] += w;
+	}
+}
+
+static double handStrengthCompute(StdDeck_CardMask us, StdDeck_CardMask board) {
 	StdDeck_CardMask opp;
 	StdDeck_CardMask dead;
 	int tot;
 	HandVal ourscore;
 	int tally[3] = { 0 };
+	SuitGroup group;
+	const EvalTable *table = evalTable();
+	EvalNFn eval;
 
   StdDeck_CardMask_RESET(dead);
 	StdDeck_CardMask_OR(dead,dead,us);
@@ -274,144 +415,1553 @@ double handStrength(StdDeck_CardMask us, StdDeck_CardMask board) {
   StdDeck_CardMask_RESET(opp);
 
 	tot = StdDeck_numCards(dead);
-	ourscore = StdDeck_StdRules_EVAL_N(dead, tot);
-
-	DECK_ENUMERATE_2_CARDS_D(StdDeck, opp, dead, evalAndTally(opp, board, ourscore, tot, tally););
+	eval = evalNSized(tot);
+	ourscore = evalTableSized(table, eval, dead, tot);
+	suitGroupFixing(&group, us, board);
+
+	if (getThreadCount() > 1 || group.n > 1 || table || eval) {
+		HandStrengthSlices job;
+		int i;
+
+		memset(&job, 0, sizeof job);
+		job.board = board;
+		job.dead = dead;
+		job.ourscore = ourscore;
+		job.tot = tot;
+		job.group = (group.n > 1) ? &group : NULL;
+		job.table = table;
+		job.eval = eval;
+		if (getThreadCount() > 1)
+			poolRun(handStrengthSlice, &job, StdDeck_N_CARDS);
+		else
+			for (i = 0; i < StdDeck_N_CARDS; i++)
+				handStrengthSlice(&job, i);
+		for (i = 0; i < StdDeck_N_CARDS; i++) {
+			tally[0] += job.tally[i][0];
+			tally[1] += job.tally[i][1];
+			tally[2] += job.tally[i][2];
+		}
+	}
+	else {
+		DECK_ENUMERATE_2_CARDS_D(StdDeck, opp, dead, evalAndTally(opp, board, ourscore, tot, tally););
+		EVAL_STAT_ADD(EVAL_STAT_HAND_STRENGTH, evals, tally[0] + tally[1] + tally[2]);
+	}
+	EVAL_STAT_ADD(EVAL_STAT_HAND_STRENGTH, evals, 1);
+	EVAL_STAT_ADD(EVAL_STAT_HAND_STRENGTH, combos, tally[0] + tally[1] + tally[2]);
 	return ((tally[2] + tally[1] / 2.0) / (tally[0] + tally[1] + tally[2]));
 }
 
-int scoreTwoCards(char* str_pocket, char* str_board, void *callback(int, StdDeck_CardMask)) {
+double handStrength(StdDeck_CardMask us, StdDeck_CardMask board) {
+	uint64 key = spotKey(us, board, SPOT_HS);
+	double hs, unused;
+	EVAL_STAT_BEGIN(stat);
+
+	if (!spotCacheGet(key, &hs, &unused)) {
+		hs = handStrengthCompute(us, board);
+		spotCachePut(key, hs, 0);
+	}
+	EVAL_STAT_END(EVAL_STAT_HAND_STRENGTH, stat);
+	return hs;
+}
+
+/*
+ * Hand strength against a weighted opponent range.  weights holds one weight
+ * per opponent hand, indexed by COMBO_INDEX of its two card indices.
+ */
+double handStrengthWeighted(StdDeck_CardMask us, StdDeck_CardMask board, const float *weights) {
+	StdDeck_CardMask dead, opp;
+	HandVal ourscore, oppscore;
+	double ahead = 0, tied = 0, behind = 0;
+	int tot, i1, i2;
+	float w;
+	EvalNFn eval;
+
+	StdDeck_CardMask_OR(dead, us, board);
+	tot = StdDeck_numCards(dead);
+	eval = evalNSized(tot);
+	ourscore = evalTableSized(NULL, eval, dead, tot);
+
+	for (i1 = StdDeck_N_CARDS - 1; i1 >= 0; i1--) {
+		if (StdDeck_CardMask_CARD_IS_SET(dead, i1))
+			continue;
+		for (i2 = i1 - 1; i2 >= 0; i2--) {
+			if (StdDeck_CardMask_CARD_IS_SET(dead, i2))
+				continue;
+			w = weights[COMBO_INDEX(i1, i2)];
+			if (w == 0)
+				continue;
+			StdDeck_CardMask_OR(opp, StdDeck_MASK(i1), StdDeck_MASK(i2));
+			StdDeck_CardMask_OR(opp, opp, board);
+			oppscore = evalTableSized(NULL, eval, opp, tot);
+			if (ourscore > oppscore)
+				ahead += w;
+			else if (ourscore == oppscore)
+				tied += w;
+			else
+				behind += w;
+		}
+	}
+	return ((ahead + tied / 2.0) / (ahead + tied + behind));
+}
+
+/*
+ * Range against range equity.  hero and villain hold one weight per hand,
+ * indexed by COMBO_INDEX.  Every completion of the board is a runout; for
+ * each one the live hands of both ranges are evaluated once and sorted, and
+ * a sweep over them gives each hero hand the villain weight it beats and
+ * ties.  The villain hands that share a card with a hero hand are taken out
+ * of those sums by inclusion-exclusion over per-card sums, so a runout
+ * costs O(n log n) rather than a comparison per pair of hands.
+ *
+ * Runouts are enumerated when (hero + villain hands) * runouts is at most
+ * max_work, and otherwise samples of them are drawn at random.
+ */
+#define RANGE_CHUNKS 64
+
+typedef struct {
+	HandVal val;
+	float w;
+	short combo;
+	uint8 c1, c2;
+} RangeHand;
+
+typedef struct {
+	const float *hero;
+	const float *villain;
 	StdDeck_CardMask board;
+	const EvalTable *table;
+	int nhero, nvillain;
+	short herocombos[N_COMBOS];
+	short villaincombos[N_COMBOS];
+	StdDeck_CardMask combomask[N_COMBOS];
+	uint8 card1[N_COMBOS], card2[N_COMBOS];
+	/* enumerated runouts, or NULL to sample */
+	StdDeck_CardMask *runouts;
+	int nrunouts;
+	int nchunks;
+	int live[StdDeck_N_CARDS];
+	int nlive, need;
+	uint64 seed;
+	double (*num)[N_COMBOS];
+	double (*den)[N_COMBOS];
+} RangeJob;
+
+static int compareRangeHands(const void *a, const void *b) {
+	HandVal x = ((const RangeHand *) a)->val, y = ((const RangeHand *) b)->val;
+
+	return (x > y) - (x < y);
+}
+
+/* Collects the hands of one range that the runout leaves live, evaluated
+ * and sorted by value */
+static int rangeHands(const RangeJob *job, const short *combos, int n, const float *weights,
+		StdDeck_CardMask runout, RangeHand *hands) {
+	StdDeck_CardMask cards[N_COMBOS];
+	HandVal vals[N_COMBOS];
+	int i, c, k = 0;
+
+	for (i = 0; i < n; i++) {
+		c = combos[i];
+		if (StdDeck_CardMask_ANY_SET(job->combomask[c], runout))
+			continue;
+		StdDeck_CardMask_OR(cards[k], job->combomask[c], runout);
+		hands[k].w = weights[c];
+		hands[k].combo = c;
+		hands[k].c1 = job->card1[c];
+		hands[k].c2 = job->card2[c];
+		k++;
+	}
+	if (k == 0)
+		return 0;
+	evalBlock(job->table, cards, 7, vals, k);
+	for (i = 0; i < k; i++)
+		hands[i].val = vals[i];
+	qsort(hands, k, sizeof *hands, compareRangeHands);
+	return k;
+}
+
+static void rangeRunout(const RangeJob *job, StdDeck_CardMask runout, double *num, double *den) {
+	RangeHand heroes[N_COMBOS], villains[N_COMBOS];
+	double all = 0, lt = 0, le = 0;
+	double cardall[StdDeck_N_CARDS] = { 0 }, cardlt[StdDeck_N_CARDS] = { 0 }, cardle[StdDeck_N_CARDS] = { 0 };
+	double beat, beattie, total, self;
+	int nh, nv, i, plt = 0, ple = 0;
+	const RangeHand *h, *v;
+
+	nh = rangeHands(job, job->herocombos, job->nhero, job->hero, runout, heroes);
+	nv = rangeHands(job, job->villaincombos, job->nvillain, job->villain, runout, villains);
+	for (i = 0; i < nv; i++) {
+		all += villains[i].w;
+		cardall[villains[i].c1] += villains[i].w;
+		cardall[villains[i].c2] += villains[i].w;
+	}
+	for (i = 0; i < nh; i++) {
+		h = &heroes[i];
+		for (; plt < nv && villains[plt].val < h->val; plt++) {
+			v = &villains[plt];
+			lt += v->w;
+			cardlt[v->c1] += v->w;
+			cardlt[v->c2] += v->w;
+		}
+		for (; ple < nv && villains[ple].val <= h->val; ple++) {
+			v = &villains[ple];
+			le += v->w;
+			cardle[v->c1] += v->w;
+			cardle[v->c2] += v->w;
+		}
+		/* the villain's copy of this very hand shares both cards, so is
+		 * subtracted twice; it ties, so it is never in lt */
+		self = job->villain[h->combo];
+		beat = lt - cardlt[h->c1] - cardlt[h->c2];
+		beattie = le - cardle[h->c1] - cardle[h->c2] + self;
+		total = all - cardall[h->c1] - cardall[h->c2] + self;
+		num[h->combo] += beat + (beattie - beat) / 2;
+		den[h->combo] += total;
+	}
+}
+
+static void rangeChunk(void *arg, int chunk) {
+	RangeJob *job = arg;
+	StdDeck_CardMask runout;
+	PokerRand rng;
+	int live[StdDeck_N_CARDS];
+	int lo = (int) ((long) chunk * job->nrunouts / job->nchunks);
+	int hi = (int) ((long) (chunk + 1) * job->nrunouts / job->nchunks);
+	int r, k, j, t;
+
+	if (job->runouts) {
+		for (r = lo; r < hi; r++)
+			rangeRunout(job, job->runouts[r], job->num[chunk], job->den[chunk]);
+		return;
+	}
+
+	/* each chunk draws from its own generator, so the result doesn't
+	 * depend on the number of threads */
+	pokerRandSeed(&rng, job->seed + chunk);
+	memcpy(live, job->live, sizeof live);
+	for (r = lo; r < hi; r++) {
+		runout = job->board;
+		for (k = 0; k < job->need; k++) {
+			j = k + pokerRandBelow(&rng, job->nlive - k);
+			t = live[k];
+			live[k] = live[j];
+			live[j] = t;
+			StdDeck_CardMask_OR(runout, runout, StdDeck_MASK(live[k]));
+		}
+		rangeRunout(job, runout, job->num[chunk], job->den[chunk]);
+	}
+}
+
+/* Every way of adding need of the live cards to board */
+static int rangeRunouts(StdDeck_CardMask board, const int *live, int nlive, int need, StdDeck_CardMask *runouts) {
+	int idx[5];
+	int k, n = 0;
+
+	for (k = 0; k < need; k++)
+		idx[k] = k;
+	for (;;) {
+		runouts[n] = board;
+		for (k = 0; k < need; k++)
+			StdDeck_CardMask_OR(runouts[n], runouts[n], StdDeck_MASK(live[idx[k]]));
+		n++;
+		for (k = need - 1; k >= 0 && idx[k] == nlive - need + k; k--)
+			;
+		if (k < 0)
+			return n;
+		idx[k]++;
+		for (k++; k < need; k++)
+			idx[k] = idx[k - 1] + 1;
+	}
+}
+
+/* Enumerates the runouts if that takes at most max_work hand evaluations,
+ * and samples them otherwise.  res is left as it is unless there is a
+ * result. */
+static void rangeRun(RangeJob *job, int max_work, int samples, RangeEquity *res, double *combo_equity) {
+	double runouts, num, den, hnum = 0, hden = 0;
+	int k, c, chunk, exact = 0;
+
+	if (job->nhero == 0 || job->nvillain == 0)
+		return;
+	runouts = 1;
+	for (k = 0; k < job->need; k++)
+		runouts = runouts * (job->nlive - k) / (k + 1);
+	if ((job->nhero + job->nvillain) * runouts <= max_work) {
+		job->nrunouts = (int) runouts;
+		job->runouts = malloc(job->nrunouts * sizeof *job->runouts);
+		if (job->runouts == NULL)
+			return;
+		rangeRunouts(job->board, job->live, job->nlive, job->need, job->runouts);
+		exact = 1;
+	}
+	else
+		job->nrunouts = samples;
+	job->nchunks = job->nrunouts < RANGE_CHUNKS ? job->nrunouts : RANGE_CHUNKS;
+	if (job->nchunks < 1)
+		return;
+	job->num = calloc(job->nchunks, sizeof *job->num);
+	job->den = calloc(job->nchunks, sizeof *job->den);
+	if (job->num == NULL || job->den == NULL)
+		return;
+
+	if (getThreadCount() > 1)
+		poolRun(rangeChunk, job, job->nchunks);
+	else
+		for (chunk = 0; chunk < job->nchunks; chunk++)
+			rangeChunk(job, chunk);
+
+	for (k = 0; k < job->nhero; k++) {
+		c = job->herocombos[k];
+		num = den = 0;
+		for (chunk = 0; chunk < job->nchunks; chunk++) {
+			num += job->num[chunk][c];
+			den += job->den[chunk][c];
+		}
+		if (den <= 0)
+			continue;
+		if (combo_equity)
+			combo_equity[c] = num / den;
+		hnum += job->hero[c] * num;
+		hden += job->hero[c] * den;
+	}
+	if (hden > 0)
+		res->equity = hnum / hden;
+	res->exact = exact;
+	res->runouts = job->nrunouts;
+}
+
+/*
+ * Equity of the hero range against the villain range on board, which may
+ * hold 0 to 5 cards.  If combo_equity is not NULL it receives each hero
+ * hand's equity, or -1 for hands that are blocked, out of the range or
+ * have no villain hand to face.  The aggregate weights each hero hand by
+ * its weight and the villain weight it faces.
+ */
+RangeEquity rangeEquity(const float *hero, const float *villain, StdDeck_CardMask board,
+		int max_work, int samples, uint64 seed, double *combo_equity) {
+	RangeEquity res = { -1, 0, 0 };
+	RangeJob *job;
+	double vall = 0, vcard[StdDeck_N_CARDS] = { 0 };
+	int i1, i2, c, k, n;
+
+	if (combo_equity)
+		for (c = 0; c < N_COMBOS; c++)
+			combo_equity[c] = -1;
+	if (StdDeck_numCards(board) > 5 || (job = calloc(1, sizeof *job)) == NULL)
+		return res;
+
+	job->hero = hero;
+	job->villain = villain;
+	job->board = board;
+	job->table = evalTable();
+	job->seed = seed;
+	for (i1 = 1; i1 < StdDeck_N_CARDS; i1++) {
+		for (i2 = 0; i2 < i1; i2++) {
+			c = COMBO_INDEX(i1, i2);
+			job->card1[c] = i1;
+			job->card2[c] = i2;
+			StdDeck_CardMask_OR(job->combomask[c], StdDeck_MASK(i1), StdDeck_MASK(i2));
+			if (StdDeck_CardMask_ANY_SET(job->combomask[c], board))
+				continue;
+			if (hero[c] > 0)
+				job->herocombos[job->nhero++] = c;
+			if (villain[c] > 0)
+				job->villaincombos[job->nvillain++] = c;
+		}
+	}
+	/* hero hands that every villain hand is blocked from face no weight,
+	 * so have no equity; they are dropped before anything is enumerated */
+	for (k = 0; k < job->nvillain; k++) {
+		c = job->villaincombos[k];
+		vall += villain[c];
+		vcard[job->card1[c]] += villain[c];
+		vcard[job->card2[c]] += villain[c];
+	}
+	for (k = 0, n = 0; k < job->nhero; k++) {
+		c = job->herocombos[k];
+		if (vall - vcard[job->card1[c]] - vcard[job->card2[c]] + (villain[c] > 0 ? villain[c] : 0) > 0)
+			job->herocombos[n++] = c;
+	}
+	job->nhero = n;
+	for (c = 0; c < StdDeck_N_CARDS; c++)
+		if (!StdDeck_CardMask_CARD_IS_SET(board, c))
+			job->live[job->nlive++] = c;
+	job->need = 5 - StdDeck_numCards(board);
+
+	rangeRun(job, max_work, samples, &res, combo_equity);
+	free(job->runouts);
+	free(job->num);
+	free(job->den);
+	free(job);
+	return res;
+}
+
+/*
+ * Exact equity against 1 to MW_MAX_OPPONENTS random hands.
+ *
+ * On a complete board the opponent hands that don't beat ours are edges of
+ * a graph on the live cards, weighted 1 if they lose to us and x if they
+ * tie.  A deal of k opponents that doesn't beat us is then a matching of k
+ * edges, weighted x^j if j of them tie, and our share of the pot in it is
+ * 1 / (j + 1), the integral of x^j over [0, 1].  So summing the weighted
+ * count of k-matchings over x with Boole's rule, exact for the degree-4
+ * polynomial it is, gives our pot share over all deals at once, and x = 0
+ * and x = 1 give the deals we win outright and those we don't lose.
+ *
+ * Matchings of up to three edges are counted in closed form from vertex
+ * degrees, paths and triangles, by inclusion-exclusion over the ways the
+ * edges can meet; four-edge matchings take one explicit edge and count the
+ * three-edge matchings of the rest.  Nothing enumerates opponent tuples.
+ */
+#define MW_CHUNKS 64
+
+typedef struct {
+	int n;
+	double a[StdDeck_N_CARDS][StdDeck_N_CARDS];
+	double a2[StdDeck_N_CARDS][StdDeck_N_CARDS];
+	double d[StdDeck_N_CARDS], q2[StdDeck_N_CARDS], q3[StdDeck_N_CARDS];
+	double ad[StdDeck_N_CARDS], a2d[StdDeck_N_CARDS], tri[StdDeck_N_CARDS];
+	/* total weight, sums of squared and cubed weights, d.A.d, triangles */
+	double m, p2, p3, dad, t;
+} MatchGraph;
+
+static void matchGraphInit(MatchGraph *g, int k) {
+	int i, j, v;
+	double w;
+
+	g->m = g->p2 = g->p3 = g->dad = g->t = 0;
+	for (i = 0; i < g->n; i++) {
+		g->d[i] = g->q2[i] = g->q3[i] = 0;
+		for (j = 0; j < g->n; j++) {
+			w = g->a[i][j];
+			g->d[i] += w;
+			g->q2[i] += w * w;
+			g->q3[i] += w * w * w;
+		}
+		g->m += g->d[i] / 2;
+		g->p2 += g->q2[i] / 2;
+		g->p3 += g->q3[i] / 2;
+	}
+	if (k < 3)
+		return;
+	for (i = 0; i < g->n; i++) {
+		g->ad[i] = 0;
+		for (j = 0; j < g->n; j++)
+			g->ad[i] += g->a[i][j] * g->d[j];
+		g->dad += g->d[i] * g->ad[i];
+	}
+	for (i = 0; i < g->n; i++) {
+		g->a2d[i] = 0;
+		for (j = 0; j < g->n; j++)
+			g->a2d[i] += g->a[i][j] * g->ad[j];
+	}
+	for (i = 0; i < g->n; i++) {
+		for (j = 0; j < g->n; j++) {
+			w = 0;
+			for (v = 0; v < g->n; v++)
+				w += g->a[i][v] * g->a[v][j];
+			g->a2[i][j] = w;
+		}
+	}
+	for (i = 0; i < g->n; i++) {
+		g->tri[i] = 0;
+		for (j = 0; j < g->n; j++)
+			g->tri[i] += g->a2[i][j] * g->a[j][i];
+		g->tri[i] /= 2;
+		g->t += g->tri[i] / 3;
+	}
+}
+
+/* (A^3)[i][j] */
+static double matchGraphA3(const MatchGraph *g, int i, int j) {
+	double s = 0;
+	int v;
+
+	for (v = 0; v < g->n; v++)
+		s += g->a2[i][v] * g->a[v][j];
+	return s;
+}
+
+/*
+ * Weighted count of the three-edge matchings of the graph without vertices
+ * c1 and c2, or of the whole graph if c1 is -1.  With e3 the third
+ * elementary symmetric sum of the edge weights, this is e3 less the
+ * triples where some pair of edges meets: stars, paths and triangles.
+ */
+static double matchGraphM3(const MatchGraph *g, int c1, int c2) {
+	double m = g->m, p2 = g->p2, p3 = g->p3, t = g->t, yay = g->dad;
+	double s2 = 0, s3 = 0, x = 0, dq = 0, d, q2, q3, e3;
+	int v;
+
+	if (c1 >= 0) {
+		double w = g->a[c1][c2], al, be, au1, au2, uau;
+
+		m -= g->d[c1] + g->d[c2] - w;
+		p2 -= g->q2[c1] + g->q2[c2] - w * w;
+		p3 -= g->q3[c1] + g->q3[c2] - w * w * w;
+		t -= g->tri[c1] + g->tri[c2] - w * g->a2[c1][c2];
+		/* y.A.y for y the degrees without c1 and c2, y = d - a1 - a2 with
+		 * its c1 and c2 entries zeroed, from the precomputed products */
+		uau = g->dad - 2 * g->a2d[c1] - 2 * g->a2d[c2]
+			+ matchGraphA3(g, c1, c1) + 2 * matchGraphA3(g, c1, c2) + matchGraphA3(g, c2, c2);
+		au1 = g->ad[c1] - g->a2[c1][c1] - g->a2[c1][c2];
+		au2 = g->ad[c2] - g->a2[c2][c1] - g->a2[c2][c2];
+		al = g->d[c1] - w;
+		be = g->d[c2] - w;
+		yay = uau - 2 * (al * au1 + be * au2) + 2 * al * be * w;
+	}
+	for (v = 0; v < g->n; v++) {
+		if (v == c1 || v == c2)
+			continue;
+		d = g->d[v];
+		q2 = g->q2[v];
+		q3 = g->q3[v];
+		if (c1 >= 0) {
+			double w1 = g->a[v][c1], w2 = g->a[v][c2];
+
+			d -= w1 + w2;
+			q2 -= w1 * w1 + w2 * w2;
+			q3 -= w1 * w1 * w1 + w2 * w2 * w2;
+		}
+		s2 += (d * d - q2) / 2;
+		s3 += (d * d * d - 3 * d * q2 + 2 * q3) / 6;
+		x += q2 * d - q3;
+		dq += d * q2;
+	}
+	/* pairs of edges meeting, each with a third edge */
+	x = m * s2 - x;
+	e3 = (m * m * m - 3 * m * p2 + 2 * p3) / 6;
+	/* yay / 2 - dq + p3 counts three-edge paths, triangles three times */
+	return e3 - x + (yay / 2 - dq + p3) - t + 2 * s3;
+}
+
+/* Weighted count of the k-edge matchings, for k up to 4 */
+static double matchGraphCount(const MatchGraph *g, int k) {
+	double s2 = 0, sum = 0;
+	int i, j;
+
+	switch (k) {
+	case 1:
+		return g->m;
+	case 2:
+		for (i = 0; i < g->n; i++)
+			s2 += (g->d[i] * g->d[i] - g->q2[i]) / 2;
+		return (g->m * g->m - g->p2) / 2 - s2;
+	case 3:
+		return matchGraphM3(g, -1, -1);
+	default:
+		for (i = 0; i < g->n; i++)
+			for (j = 0; j < i; j++)
+				if (g->a[i][j] != 0)
+					sum += g->a[i][j] * matchGraphM3(g, i, j);
+		return sum / 4;
+	}
+}
+
+typedef struct {
 	StdDeck_CardMask pocket;
+	const EvalTable *table;
+	int opponents;
+	int tot;
+	/* runouts: the board, or every completion of it */
+	StdDeck_CardMask *runouts;
+	int nrunouts;
+	int nchunks;
+	/* per chunk: deals won, not lost, pot share and in all */
+	double (*acc)[4];
+} MultiwayJob;
+
+static void multiwayRunout(const MultiwayJob *job, StdDeck_CardMask runout, double *acc) {
+	static const double boole[5] = { 7 / 90.0, 32 / 90.0, 12 / 90.0, 32 / 90.0, 7 / 90.0 };
+	StdDeck_CardMask dead, cards[StdDeck_N_CARDS * (StdDeck_N_CARDS - 1) / 2];
+	HandVal ours, vals[StdDeck_N_CARDS * (StdDeck_N_CARDS - 1) / 2];
+	MatchGraph g;
+	int live[StdDeck_N_CARDS];
+	int i, j, k, n = 0, ties = 0, cnt;
+	double f, all;
+
+	StdDeck_CardMask_OR(dead, job->pocket, runout);
+	StdDeck_CardMask_OR(cards[0], job->pocket, runout);
+	ours = evalTableN(job->table, cards[0], job->tot);
+	for (i = 0; i < StdDeck_N_CARDS; i++)
+		if (!StdDeck_CardMask_CARD_IS_SET(dead, i))
+			live[n++] = i;
+
+	for (i = 0, cnt = 0; i < n; i++) {
+		for (j = 0; j < i; j++) {
+			StdDeck_CardMask_OR(cards[cnt], StdDeck_MASK(live[i]), StdDeck_MASK(live[j]));
+			StdDeck_CardMask_OR(cards[cnt], cards[cnt], runout);
+			cnt++;
+		}
+	}
+	evalBlock(job->table, cards, job->tot, vals, cnt);
+	for (i = 0, cnt = 0; i < n; i++) {
+		for (j = 0; j < i; j++, cnt++)
+			ties += vals[cnt] == ours;
+	}
+
+	/* every deal: n! / ((n - 2k)! k! 2^k) */
+	all = 1;
+	for (i = 0; i < 2 * job->opponents; i++)
+		all *= n - i;
+	for (i = 1; i <= job->opponents; i++)
+		all /= 2 * i;
+
+	g.n = n;
+	for (k = 0; k < 5; k++) {
+		double x = k / 4.0;
+
+		for (i = 0, cnt = 0; i < n; i++) {
+			g.a[i][i] = 0;
+			for (j = 0; j < i; j++, cnt++) {
+				g.a[i][j] = vals[cnt] < ours ? 1 : vals[cnt] == ours ? x : 0;
+				g.a[j][i] = g.a[i][j];
+			}
+		}
+		matchGraphInit(&g, job->opponents);
+		f = matchGraphCount(&g, job->opponents);
+		if (ties == 0) {
+			/* no ties, so the count doesn't depend on x */
+			acc[0] += f;
+			acc[1] += f;
+			acc[2] += f;
+			break;
+		}
+		if (k == 0)
+			acc[0] += f;
+		if (k == 4)
+			acc[1] += f;
+		acc[2] += boole[k] * f;
+	}
+	acc[3] += all;
+}
+
+static void multiwayChunk(void *arg, int chunk) {
+	MultiwayJob *job = arg;
+	int lo = chunk * job->nrunouts / job->nchunks;
+	int hi = (chunk + 1) * job->nrunouts / job->nchunks;
+	int r;
+
+	for (r = lo; r < hi; r++)
+		multiwayRunout(job, job->runouts[r], job->acc[chunk]);
+}
+
+/* Sets up the job for multiwayEquity, with its runouts.  Returns 0 for
+ * unsupported spots or if out of memory. */
+static int multiwaySetup(MultiwayJob *job, StdDeck_CardMask pocket, StdDeck_CardMask board, int num_opponents, int to_river) {
+	int live[StdDeck_N_CARDS];
+	int nboard, nlive = 0, c, i;
+	StdDeck_CardMask dead;
+
+	nboard = StdDeck_numCards(board);
+	StdDeck_CardMask_OR(dead, pocket, board);
+	if (num_opponents < 1 || num_opponents > MW_MAX_OPPONENTS || StdDeck_numCards(pocket) != 2
+			|| StdDeck_CardMask_ANY_SET(pocket, board) || nboard > 5 || (to_river && nboard < 3))
+		return 0;
+
+	job->pocket = pocket;
+	job->table = evalTable();
+	job->opponents = num_opponents;
+	if (to_river) {
+		for (c = 0; c < StdDeck_N_CARDS; c++)
+			if (!StdDeck_CardMask_CARD_IS_SET(dead, c))
+				live[nlive++] = c;
+		job->tot = 7;
+		job->nrunouts = 1;
+		for (i = 0; i < 5 - nboard; i++)
+			job->nrunouts = job->nrunouts * (nlive - i) / (i + 1);
+	}
+	else {
+		job->tot = 2 + nboard;
+		job->nrunouts = 1;
+	}
+	if (2 * num_opponents > StdDeck_N_CARDS - 2 - (to_river ? 5 : nboard))
+		return 0;
+	job->runouts = malloc(job->nrunouts * sizeof *job->runouts);
+	job->nchunks = job->nrunouts < MW_CHUNKS ? job->nrunouts : MW_CHUNKS;
+	job->acc = calloc(job->nchunks, sizeof *job->acc);
+	if (job->runouts == NULL || job->acc == NULL) {
+		free(job->runouts);
+		free(job->acc);
+		return 0;
+	}
+	if (to_river)
+		rangeRunouts(board, live, nlive, 5 - nboard, job->runouts);
+	else
+		job->runouts[0] = board;
+	return 1;
+}
+
+/* The result from the sums of the chunks' tallies */
+static MultiwayEquity multiwayResult(const double *acc) {
+	MultiwayEquity res;
+
+	res.win = acc[0] / acc[3];
+	res.tie = (acc[1] - acc[0]) / acc[3];
+	res.lose = 1 - acc[1] / acc[3];
+	res.equity = acc[2] / acc[3];
+	return res;
+}
+
+/*
+ * Our chances against num_opponents random hands, dealt from the cards
+ * that are left.  With to_river the board, of 3 to 5 cards, is dealt out
+ * to the river; otherwise the hands are compared on the board as it is,
+ * which gives hand strength.  All fields are -1 for unsupported spots.
+ */
+MultiwayEquity multiwayEquity(StdDeck_CardMask pocket, StdDeck_CardMask board, int num_opponents, int to_river) {
+	MultiwayEquity res = { -1, -1, -1, -1 };
+	MultiwayJob job;
+	double acc[4] = { 0, 0, 0, 0 };
+	int chunk, i;
+
+	if (!multiwaySetup(&job, pocket, board, num_opponents, to_river))
+		return res;
+
+	if (getThreadCount() > 1)
+		poolRun(multiwayChunk, &job, job.nchunks);
+	else
+		for (chunk = 0; chunk < job.nchunks; chunk++)
+			multiwayChunk(&job, chunk);
+	for (chunk = 0; chunk < job.nchunks; chunk++)
+		for (i = 0; i < 4; i++)
+			acc[i] += job.acc[chunk][i];
+	free(job.runouts);
+	free(job.acc);
+	return multiwayResult(acc);
+}
+
+/*
+ * multiwayEquity as a job.  Runouts come in order of their cards, so each
+ * chunk takes every nchunks'th one rather than a run of them, and the
+ * chunks done so far give a fair estimate.
+ */
+static int multiwayJobChunk(void *state, EvalJob *ej, int chunk) {
+	MultiwayJob *job = state;
+	int r;
+
+	for (r = chunk; r < job->nrunouts; r += job->nchunks) {
+		if (jobCancelled(ej))
+			return 0;
+		multiwayRunout(job, job->runouts[r], job->acc[chunk]);
+		jobAdvance(ej, 1);
+	}
+	return 1;
+}
+
+static void multiwayJobEstimate(void *state, const uint8 *done, double *result) {
+	const MultiwayJob *job = state;
+	double acc[4] = { 0, 0, 0, 0 };
+	MultiwayEquity res;
+	int chunk, i;
+
+	for (chunk = 0; chunk < job->nchunks; chunk++)
+		if (done[chunk])
+			for (i = 0; i < 4; i++)
+				acc[i] += job->acc[chunk][i];
+	res = multiwayResult(acc);
+	result[0] = res.win;
+	result[1] = res.tie;
+	result[2] = res.lose;
+	result[3] = res.equity;
+}
+
+static void multiwayJobRelease(void *state) {
+	MultiwayJob *job = state;
+
+	free(job->runouts);
+	free(job->acc);
+	free(job);
+}
+
+static const EvalJobKind multiway_job_kind = {
+	multiwayJobChunk, multiwayJobEstimate, NULL, multiwayJobRelease
+};
+
+EvalJob *multiwayEquityJob(StdDeck_CardMask pocket, StdDeck_CardMask board, int num_opponents, int to_river) {
+	MultiwayJob *job = malloc(sizeof *job);
+
+	if (job == NULL || !multiwaySetup(job, pocket, board, num_opponents, to_river)) {
+		free(job);
+		return NULL;
+	}
+	return jobSubmit(&multiway_job_kind, job, job->nchunks, job->nrunouts);
+}
+
+typedef struct {
+	StdDeck_CardMask board;
+	StdDeck_CardMask dead;
+	int tot;
+	const EvalTable *table;
+	EvalNFn eval;
+	HandVal scores[StdDeck_N_CARDS][StdDeck_N_CARDS];
+} ScoreTwoCardsSlices;
+
+static void scoreTwoCardsSlice(void *arg, int i1) {
+	ScoreTwoCardsSlices *job = arg;
+	StdDeck_CardMask opp;
+	int i2;
+
+	if (StdDeck_CardMask_CARD_IS_SET(job->dead, i1))
+		return;
+	for (i2 = i1 - 1; i2 >= 0; i2--) {
+		if (StdDeck_CardMask_CARD_IS_SET(job->dead, i2))
+			continue;
+		StdDeck_CardMask_OR(opp, StdDeck_MASK(i1), StdDeck_MASK(i2));
+		StdDeck_CardMask_OR(opp, opp, job->board);
+		job->scores[i1][i2] = evalTableSized(job->table, job->eval, opp, job->tot);
+	}
+}
+
+int scoreTwoCards(char* str_pocket, char* str_board, void *callback(int, StdDeck_CardMask)) {
+	return scoreTwoCardsMask(TextToPokerEval(str_pocket), TextToPokerEval(str_board), callback);
+}
+
+int scoreTwoCardsMask(StdDeck_CardMask pocket, StdDeck_CardMask board, void *callback(int, StdDeck_CardMask)) {
 	StdDeck_CardMask dead;
 	StdDeck_CardMask opp;
 	int tot;
+	const EvalTable *table = evalTable();
+	EVAL_STAT_BEGIN(stat);
 
   StdDeck_CardMask_RESET(opp);
-  StdDeck_CardMask_RESET(pocket);
-  StdDeck_CardMask_RESET(board);
   StdDeck_CardMask_RESET(dead);
-	pocket = TextToPokerEval(str_pocket);
-	board = TextToPokerEval(str_board);
-	tot = (2 + (strlen(str_board) / 2));
+	tot = 2 + maskCount(board);
 	StdDeck_CardMask_OR(dead,dead,pocket);
 	StdDeck_CardMask_OR(dead,dead,board);
-	DECK_ENUMERATE_2_CARDS_D(StdDeck, opp, dead, evalSingle(opp, board, tot, callback););
+
+	if (getThreadCount() > 1 || table || evalNSized(tot)) {
+		/* Score in parallel, then hand the results to the callback from this
+		 * thread, in the order the serial enumeration would */
+		ScoreTwoCardsSlices *job = malloc(sizeof *job);
+		int i1, i2;
+
+		job->board = board;
+		job->dead = dead;
+		job->tot = tot;
+		job->table = table;
+		job->eval = evalNSized(tot);
+		if (getThreadCount() > 1)
+			poolRun(scoreTwoCardsSlice, job, StdDeck_N_CARDS);
+		else
+			for (i1 = 0; i1 < StdDeck_N_CARDS; i1++)
+				scoreTwoCardsSlice(job, i1);
+		for (i1 = StdDeck_N_CARDS - 1; i1 >= 0; i1--) {
+			if (StdDeck_CardMask_CARD_IS_SET(dead, i1))
+				continue;
+			for (i2 = i1 - 1; i2 >= 0; i2--) {
+				if (StdDeck_CardMask_CARD_IS_SET(dead, i2))
+					continue;
+				StdDeck_CardMask_OR(opp, StdDeck_MASK(i1), StdDeck_MASK(i2));
+				EVAL_STAT_CALLBACK(EVAL_STAT_SCORE_TWO_CARDS, callback(job->scores[i1][i2], opp));
+			}
+		}
+		free(job);
+	}
+	else
+		DECK_ENUMERATE_2_CARDS_D(StdDeck, opp, dead, evalSingle(opp, board, tot, callback););
+	EVAL_STAT_ADD(EVAL_STAT_SCORE_TWO_CARDS, evals, (StdDeck_N_CARDS - tot) * (StdDeck_N_CARDS - tot - 1) / 2);
+	EVAL_STAT_ADD(EVAL_STAT_SCORE_TWO_CARDS, combos, (StdDeck_N_CARDS - tot) * (StdDeck_N_CARDS - tot - 1) / 2);
+	EVAL_STAT_END(EVAL_STAT_SCORE_TWO_CARDS, stat);
 	return 1;
 }
 
-void handPotInnerInner(StdDeck_CardMask turnriver, StdDeck_CardMask ourcards, StdDeck_CardMask oppcards, StdDeck_CardMask board, int index, int hp[][3], int maxcards) {
-	HandVal ourrank;
-	HandVal opprank;
-	StdDeck_CardMask_OR(turnriver, turnriver, board);
-	StdDeck_CardMask_OR(ourcards, ourcards, turnriver);
-	StdDeck_CardMask_OR(oppcards, oppcards, turnriver);
-	ourrank = StdDeck_StdRules_EVAL_N(ourcards, maxcards);
-	opprank = StdDeck_StdRules_EVAL_N(oppcards, maxcards);
-	if (ourrank > opprank) {
-		hp[index][2] += 1;
-	}
-	else if (ourrank == opprank) {
-		hp[index][1] += 1;
-	}
-	else {
-		hp[index][0] += 1;
+/*
+ * scoreTwoCards into a caller-owned buffer rather than through a callback,
+ * so it can run without calling back into the caller.  scores gets the
+ * value of each opponent hand with the board at the COMBO_INDEX of its
+ * cards, and 0 for the hands that share a card with ours or the board.
+ * Returns the number of hands scored, or -1 if out of memory.
+ */
+int scoreTwoCardsInto(StdDeck_CardMask pocket, StdDeck_CardMask board, HandVal *scores) {
+	ScoreTwoCardsSlices *job = malloc(sizeof *job);
+	int i1, i2, n = 0;
+	EVAL_STAT_BEGIN(stat);
+
+	if (job == NULL)
+		return -1;
+	StdDeck_CardMask_OR(job->dead, pocket, board);
+	job->board = board;
+	job->tot = 2 + StdDeck_numCards(board);
+	job->table = evalTable();
+	job->eval = evalNSized(job->tot);
+	if (getThreadCount() > 1)
+		poolRun(scoreTwoCardsSlice, job, StdDeck_N_CARDS);
+	else
+		for (i1 = 0; i1 < StdDeck_N_CARDS; i1++)
+			scoreTwoCardsSlice(job, i1);
+	for (i1 = 1; i1 < StdDeck_N_CARDS; i1++) {
+		for (i2 = 0; i2 < i1; i2++) {
+			if (StdDeck_CardMask_CARD_IS_SET(job->dead, i1) || StdDeck_CardMask_CARD_IS_SET(job->dead, i2))
+				scores[COMBO_INDEX(i1, i2)] = 0;
+			else {
+				scores[COMBO_INDEX(i1, i2)] = job->scores[i1][i2];
+				n++;
+			}
+		}
 	}
-	return;
+	free(job);
+	EVAL_STAT_ADD(EVAL_STAT_SCORE_TWO_CARDS, evals, n);
+	EVAL_STAT_ADD(EVAL_STAT_SCORE_TWO_CARDS, combos, n);
+	EVAL_STAT_END(EVAL_STAT_SCORE_TWO_CARDS, stat);
+	return n;
 }
 
-void handPotInner(HandVal ourrank, int hp[][3], int hptotal[], StdDeck_CardMask ourcards, StdDeck_CardMask board, StdDeck_CardMask oppcards, StdDeck_CardMask dead, int nboard, int maxcards) {
-	StdDeck_CardMask turnriver;
-	HandVal opprank;
-	int index;
-	int i;
+/*
+ * Hand potential is computed in two passes.  Our hand only depends on the
+ * runout, so every turn/river runout is enumerated once up front and our
+ * HandVal for it is cached in a flat array.  Then for each opponent hand we
+ * evaluate its current rank once, and walk the cached runouts, skipping
+ * the ones that use the opponent's cards; each step is a single opponent
+ * evaluation and a compare.
+ *
+ * Under the suit permutations that fix our cards and the board, only one
+ * opponent hand per orbit is visited, and for it only one runout per orbit
+ * of the permutations that also fix the opponent's cards.  Each is counted
+ * with the size of its orbit, which gives exactly the brute-force tallies.
+ */
+#define HP_MAX_RUNOUT 5
+#define HP_BLOCK 64
+
+typedef struct {
+	StdDeck_CardMask ourcards;
+	StdDeck_CardMask board;
+	StdDeck_CardMask dead;
+	HandVal ourrank;
+	int nboard;
+	int maxcards;
+	SuitGroup group;
+	const EvalTable *table;
+	/* the evaluators for the board as it is and for maxcards */
+	EvalNFn evalnow;
+	EvalNFn evalmax;
+	int runsize;
+	int nrunouts;
+	StdDeck_CardMask *runouts;
+	HandVal *ourvals;
+	int (*runcards)[HP_MAX_RUNOUT];
+} HandPotentialSpot;
+
+static void handPotentialAddRunout(HandPotentialSpot *spot, StdDeck_CardMask runout) {
+	StdDeck_CardMask cards;
+	int c, k = 0;
+
+	StdDeck_CardMask_OR(cards, spot->ourcards, runout);
+	spot->runouts[spot->nrunouts] = runout;
+	spot->ourvals[spot->nrunouts] = evalTableSized(spot->table, spot->evalmax, cards, spot->maxcards);
+	for (c = StdDeck_N_CARDS - 1; c >= 0; c--)
+		if (StdDeck_CardMask_CARD_IS_SET(runout, c))
+			spot->runcards[spot->nrunouts][k++] = c;
+	spot->nrunouts++;
+}
+
+static int choose(int n, int k) {
+	int i, r = 1;
+
+	if (k < 0 || k > n)
+		return 0;
+	for (i = 1; i <= k; i++)
+		r = r * (n - k + i) / i;
+	return r;
+}
+
+static void handPotentialOpp(const HandPotentialSpot *spot, int i1, int i2, int hp[][3], int hptotal[]) {
+	StdDeck_CardMask opp, oppcards, cards[HP_BLOCK];
+	HandVal opprank, oppvals[HP_BLOCK];
+	SuitGroup oppgroup;
+	int oppcardlist[2];
+	int runs[HP_BLOCK], weights[HP_BLOCK];
+	int index, r, w, wr, n, k;
+
+	w = 1;
+	oppgroup.n = 1;
+	if (spot->group.n > 1) {
+		w = suitOrbitWeight2(&spot->group, i1, i2);
+		if (w == 0)
+			return;
+		oppcardlist[0] = i1;
+		oppcardlist[1] = i2;
+		suitSubgroupFixing(&oppgroup, &spot->group, oppcardlist, 2);
+	}
 
-	StdDeck_CardMask_OR(oppcards, oppcards, board);
-	opprank = StdDeck_StdRules_EVAL_N(oppcards, 2 + nboard);
+	StdDeck_CardMask_OR(opp, StdDeck_MASK(i1), StdDeck_MASK(i2));
+	StdDeck_CardMask_OR(oppcards, opp, spot->board);
+	opprank = evalTableSized(spot->table, spot->evalnow, oppcards, 2 + spot->nboard);
+	EVAL_STAT_ADD(EVAL_STAT_HAND_POTENTIAL, evals, 1);
 
-	if (ourrank > opprank) {
+	if (spot->ourrank > opprank) {
 		index = 2;
-	} else if (ourrank == opprank) {
+	} else if (spot->ourrank == opprank) {
 		index = 1;
 	} else {
 		index = 0;
 	}
 
-	hptotal[index] += 1;
+	hptotal[index] += w;
+
+	/* The runouts vary a lot more than the opponent hands of a fixed board
+	 * do, so they go to the evaluator HP_BLOCK at a time */
+	for (r = 0; r < spot->nrunouts; ) {
+		for (n = 0; n < HP_BLOCK && r < spot->nrunouts; r++) {
+			if (StdDeck_CardMask_ANY_SET(spot->runouts[r], opp))
+				continue;
+			wr = w;
+			if (oppgroup.n > 1) {
+				wr = suitOrbitWeight(&oppgroup, spot->runcards[r], spot->runsize);
+				if (wr == 0)
+					continue;
+				wr *= w;
+			}
+			StdDeck_CardMask_OR(cards[n], oppcards, spot->runouts[r]);
+			runs[n] = r;
+			weights[n++] = wr;
+		}
+		evalBlock(spot->table, cards, spot->maxcards, oppvals, n);
+		EVAL_STAT_ADD(EVAL_STAT_HAND_POTENTIAL, evals, n);
+		for (k = 0; k < n; k++) {
+			if (spot->ourvals[runs[k]] > oppvals[k]) {
+				hp[index][2] += weights[k];
+			}
+			else if (spot->ourvals[runs[k]] == oppvals[k]) {
+				hp[index][1] += weights[k];
+			}
+			else {
+				hp[index][0] += weights[k];
+			}
+		}
+	}
+}
 
-	StdDeck_CardMask_OR(dead, dead, oppcards)
-  StdDeck_CardMask_RESET(turnriver);
+typedef struct {
+	const HandPotentialSpot *spot;
+	int hp[StdDeck_N_CARDS][3][3];
+	int hptotal[StdDeck_N_CARDS][3];
+} HandPotentialSlices;
+
+static void handPotentialSlice(void *arg, int i1) {
+	HandPotentialSlices *job = arg;
+	const HandPotentialSpot *spot = job->spot;
+	int i2;
+
+	if (StdDeck_CardMask_CARD_IS_SET(spot->dead, i1))
+		return;
+	for (i2 = i1 - 1; i2 >= 0; i2--) {
+		if (StdDeck_CardMask_CARD_IS_SET(spot->dead, i2))
+			continue;
+		handPotentialOpp(spot, i1, i2, job->hp[i1], job->hptotal[i1]);
+	}
+}
 
-	i = ((nboard > 3) ? (5 - nboard) : (5 - (7 - maxcards) - nboard));
+static void handPotentialRelease(HandPotentialSpot *spot) {
+	free(spot->runouts);
+	free(spot->ourvals);
+	free(spot->runcards);
+}
 
-	DECK_ENUMERATE_N_CARDS_D(StdDeck, turnriver, i, dead, handPotInnerInner(turnriver, ourcards, oppcards, board, index, hp, maxcards););
+/* Sets up the spot for the pocket and board, with its runouts.  Returns 0
+ * if out of memory. */
+static int handPotentialSetup(HandPotentialSpot *spot, StdDeck_CardMask pocket, StdDeck_CardMask board, int maxcards) {
+	StdDeck_CardMask ourcards, runout;
+	int nboard, nrunouts;
+
+	nboard = StdDeck_numCards(board);
+	StdDeck_CardMask_OR(ourcards, pocket, board);
+	spot->table = evalTable();
+	spot->evalnow = evalNSized(2 + nboard);
+	spot->evalmax = evalNSized(maxcards);
+	spot->ourcards = ourcards;
+	spot->board = board;
+	spot->dead = ourcards;
+	spot->ourrank = evalTableSized(spot->table, spot->evalnow, ourcards, 2 + nboard);
+	spot->nboard = nboard;
+	spot->maxcards = maxcards;
+	suitGroupFixing(&spot->group, pocket, board);
+	spot->runsize = (nboard > 3) ? (5 - nboard) : (5 - (7 - maxcards) - nboard);
+	spot->nrunouts = 0;
+	nrunouts = choose(StdDeck_N_CARDS - StdDeck_numCards(ourcards), spot->runsize);
+	spot->runouts = malloc(nrunouts * sizeof *spot->runouts);
+	spot->ourvals = malloc(nrunouts * sizeof *spot->ourvals);
+	spot->runcards = malloc(nrunouts * sizeof *spot->runcards);
+	if (spot->runouts == NULL || spot->ourvals == NULL || spot->runcards == NULL) {
+		handPotentialRelease(spot);
+		return 0;
+	}
+	DECK_ENUMERATE_N_CARDS_D(StdDeck, runout, spot->runsize, ourcards, handPotentialAddRunout(spot, runout););
+	EVAL_STAT_ADD(EVAL_STAT_HAND_POTENTIAL, evals, 1 + spot->nrunouts);
+	return 1;
 }
 
-HandPotential handPotential(char* str_pocket, char* str_board, int maxcards) {
+/* Positive and negative potential from the tallies of handPotentialOpp */
+static HandPotential handPotentialRatio(int hp[3][3], const int hptotal[3], int nboard, int maxcards) {
+	float mult, ppott, npott;
+	HandPotential hpot;
+
+	mult = (((2 + nboard == 5) && maxcards == 7) ? 990.0f : 45.0f);
+	ppott = (hp[0][2] + hp[0][1]/2 + hp[1][2]/2);
+	hpot.ppot = ppott / (mult * (hptotal[0] + hptotal[1] / 2.0));
+	npott = (hp[2][0] + hp[1][0]/2 + hp[2][1]/2);
+	hpot.npot = npott / (mult * (hptotal[2] + hptotal[1] / 2.0));
+	return hpot;
+}
+
+static HandPotential handPotentialCompute(StdDeck_CardMask pocket, StdDeck_CardMask board, int maxcards) {
 	int hp[3][3] = {{0}};
 	int hptotal[3] = {0};
-	int nboard;
-	float mult, ppott, npott, ppct, npct;
+	HandPotential hpot = { -1, -1 };
+	HandPotentialSpot spot;
+	HandPotentialSlices *job;
+	int i, j, k;
+
+	job = calloc(1, sizeof *job);
+	if (job == NULL || !handPotentialSetup(&spot, pocket, board, maxcards)) {
+		free(job);
+		return hpot;
+	}
+	job->spot = &spot;
+	if (getThreadCount() > 1)
+		poolRun(handPotentialSlice, job, StdDeck_N_CARDS);
+	else
+		for (i = StdDeck_N_CARDS - 1; i >= 0; i--)
+			handPotentialSlice(job, i);
+	for (i = 0; i < StdDeck_N_CARDS; i++) {
+		for (j = 0; j < 3; j++) {
+			hptotal[j] += job->hptotal[i][j];
+			for (k = 0; k < 3; k++)
+				hp[j][k] += job->hp[i][j][k];
+		}
+	}
+	free(job);
+	EVAL_STAT_ADD(EVAL_STAT_HAND_POTENTIAL, combos, hp[0][0] + hp[0][1] + hp[0][2] + hp[1][0] + hp[1][1] + hp[1][2]
+			+ hp[2][0] + hp[2][1] + hp[2][2]);
+	handPotentialRelease(&spot);
+	return handPotentialRatio(hp, hptotal, spot.nboard, maxcards);
+}
+
+HandPotential handPotentialMask(StdDeck_CardMask pocket, StdDeck_CardMask board, int maxcards) {
+	uint64 key = 0;
+	double ppot, npot;
 	HandPotential hpot;
-	HandVal ourrank;
-	
-	StdDeck_CardMask board;
-	StdDeck_CardMask pocket;
-	StdDeck_CardMask opp;
-	StdDeck_CardMask ourcards;
-	StdDeck_CardMask dead;
+	EVAL_STAT_BEGIN(stat);
 
-  StdDeck_CardMask_RESET(pocket);
-  StdDeck_CardMask_RESET(board);
-  StdDeck_CardMask_RESET(opp);
-	StdDeck_CardMask_RESET(ourcards);
-  StdDeck_CardMask_RESET(dead);
+	if (maxcards == 6 || maxcards == 7)
+		key = spotKey(pocket, board, maxcards == 6 ? SPOT_HP : SPOT_HP7);
+	if (spotCacheGet(key, &ppot, &npot)) {
+		hpot.ppot = ppot;
+		hpot.npot = npot;
+	} else {
+		hpot = handPotentialCompute(pocket, board, maxcards);
+		/* -1 is a failure; NaN, for a spot with nothing to compare, is not */
+		if (!(hpot.ppot < 0))
+			spotCachePut(key, hpot.ppot, hpot.npot);
+	}
+	EVAL_STAT_END(EVAL_STAT_HAND_POTENTIAL, stat);
+	return hpot;
+}
+
+HandPotential handPotential(char* str_pocket, char* str_board, int maxcards) {
+	return handPotentialMask(TextToPokerEval(str_pocket), TextToPokerEval(str_board), maxcards);
+}
+
+/*
+ * handPotentialMask as a job, over the opponent hands, which are dealt out
+ * to the chunks in turn.  A spot found in the spot cache has its result at
+ * once; others go into it when the job is done.
+ */
+typedef struct {
+	HandPotentialSpot spot;
+	uint64 key;
+	HandPotential cached;
+	int nchunks;
+	int nopps;
+	uint8 opps[StdDeck_N_CARDS * (StdDeck_N_CARDS - 1) / 2][2];
+	int hp[JOB_MAX_CHUNKS][3][3];
+	int hptotal[JOB_MAX_CHUNKS][3];
+} HandPotentialJob;
+
+static int handPotentialJobChunk(void *state, EvalJob *ej, int chunk) {
+	HandPotentialJob *job = state;
+	int k;
+
+	for (k = chunk; k < job->nopps; k += job->nchunks) {
+		if (jobCancelled(ej))
+			return 0;
+		handPotentialOpp(&job->spot, job->opps[k][0], job->opps[k][1], job->hp[chunk], job->hptotal[chunk]);
+		jobAdvance(ej, 1);
+	}
+	return 1;
+}
 
-	pocket = TextToPokerEval(str_pocket);
-	board = TextToPokerEval(str_board);
+static void handPotentialJobEstimate(void *state, const uint8 *done, double *result) {
+	const HandPotentialJob *job = state;
+	int hp[3][3] = {{0}};
+	int hptotal[3] = {0};
+	HandPotential hpot = job->cached;
+	int chunk, j, k;
+
+	if (job->nchunks > 0) {
+		for (chunk = 0; chunk < job->nchunks; chunk++) {
+			if (!done[chunk])
+				continue;
+			for (j = 0; j < 3; j++) {
+				hptotal[j] += job->hptotal[chunk][j];
+				for (k = 0; k < 3; k++)
+					hp[j][k] += job->hp[chunk][j][k];
+			}
+		}
+		hpot = handPotentialRatio(hp, hptotal, job->spot.nboard, job->spot.maxcards);
+	}
+	result[0] = hpot.ppot;
+	result[1] = hpot.npot;
+}
 
-	nboard = strlen(str_board) / 2;
+static void handPotentialJobFinish(void *state, const double *result) {
+	const HandPotentialJob *job = state;
 
-	StdDeck_CardMask_OR(ourcards,ourcards,pocket);
-	StdDeck_CardMask_OR(ourcards,ourcards,board);
-	StdDeck_CardMask_OR(dead,dead,ourcards);
-	ourrank = StdDeck_StdRules_EVAL_N(ourcards, 2 + nboard);
-	DECK_ENUMERATE_2_CARDS_D(StdDeck, opp, dead, handPotInner(ourrank, hp, hptotal, ourcards, board, opp, dead, nboard, maxcards););
+	spotCachePut(job->key, result[0], result[1]);
+}
 
-	mult = (((2 + nboard == 5) && maxcards == 7) ? 990.0f : 45.0f);
-	ppott = (hp[0][2] + hp[0][1]/2 + hp[1][2]/2);
-	ppct = ppott / (mult * (hptotal[0] + hptotal[1] / 2.0));
-	npott = (hp[2][0] + hp[1][0]/2 + hp[2][1]/2);
-	npct = npott / (mult * (hptotal[2] + hptotal[1] / 2.0));
-	hpot.ppot = ppct;
-	hpot.npot = npct;
+static void handPotentialJobRelease(void *state) {
+	HandPotentialJob *job = state;
 
-	return hpot;
+	handPotentialRelease(&job->spot);
+	free(job);
+}
+
+static const EvalJobKind hand_potential_job_kind = {
+	handPotentialJobChunk, handPotentialJobEstimate, handPotentialJobFinish, handPotentialJobRelease
+};
+
+/* Only for the spots handPotentialMask caches: the flop with maxcards of 6
+ * or 7, or the turn with 7.  On the river, with no cards to come, the job
+ * is done at once with a potential of 0 either way. */
+EvalJob *handPotentialJob(StdDeck_CardMask pocket, StdDeck_CardMask board, int maxcards) {
+	HandPotentialJob *job;
+	double ppot, npot;
+	int nboard = StdDeck_numCards(board), i1, i2;
+
+	if (StdDeck_numCards(pocket) != 2 || StdDeck_CardMask_ANY_SET(pocket, board)
+			|| !((nboard == 3 && maxcards == 6) || ((nboard == 3 || nboard == 4) && maxcards == 7)
+				|| nboard == 5))
+		return NULL;
+	job = calloc(1, sizeof *job);
+	if (job == NULL)
+		return NULL;
+	if (nboard == 5)
+		return jobSubmit(&hand_potential_job_kind, job, 0, 0);
+	job->key = spotKey(pocket, board, maxcards == 6 ? SPOT_HP : SPOT_HP7);
+	if (spotCacheGet(job->key, &ppot, &npot)) {
+		job->cached.ppot = ppot;
+		job->cached.npot = npot;
+		return jobSubmit(&hand_potential_job_kind, job, 0, 0);
+	}
+	if (!handPotentialSetup(&job->spot, pocket, board, maxcards)) {
+		free(job);
+		return NULL;
+	}
+	for (i1 = StdDeck_N_CARDS - 1; i1 >= 0; i1--) {
+		if (StdDeck_CardMask_CARD_IS_SET(job->spot.dead, i1))
+			continue;
+		for (i2 = i1 - 1; i2 >= 0; i2--) {
+			if (StdDeck_CardMask_CARD_IS_SET(job->spot.dead, i2))
+				continue;
+			if (job->spot.group.n > 1 && suitOrbitWeight2(&job->spot.group, i1, i2) == 0)
+				continue;
+			job->opps[job->nopps][0] = i1;
+			job->opps[job->nopps][1] = i2;
+			job->nopps++;
+		}
+	}
+	job->nchunks = job->nopps < JOB_MAX_CHUNKS ? job->nopps : JOB_MAX_CHUNKS;
+	return jobSubmit(&hand_potential_job_kind, job, job->nchunks, job->nopps);
 }
 
 int evalOuts(char* str_pocket, int npockets, char* str_board, int nboard, int totboard, void *callback(int, StdDeck_CardMask)) {
+		return evalOutsMask(TextToPokerEval(str_pocket), TextToPokerEval(str_board), totboard, callback);
+}
+
+int evalOutsMask(StdDeck_CardMask pocket, StdDeck_CardMask board, int totboard, void *callback(int, StdDeck_CardMask)) {
 		// totboard = total cards wanted on board
-		int i = totboard - nboard; // total cards to enumerate
+		int i = totboard - maskCount(board); // total cards to enumerate
 		int tot = totboard + 2; // total cards including player
-    StdDeck_CardMask board;
     StdDeck_CardMask dead;
-    StdDeck_CardMask pocket;
-    StdDeck_CardMask_RESET(pocket);
-    StdDeck_CardMask_RESET(board);
+		EVAL_STAT_BEGIN(stat);
     StdDeck_CardMask_RESET(dead);
 
-		pocket = TextToPokerEval(str_pocket);
-		board = TextToPokerEval(str_board);
 		StdDeck_CardMask_OR(dead,dead,pocket);
 		StdDeck_CardMask_OR(dead,dead,board);
 
 		StdDeck_CardMask_OR(pocket, pocket, board);
-		printf("I'm OK!\n");
 
 		DECK_ENUMERATE_N_CARDS_D(StdDeck, board, i, dead, evalSingleType(pocket, board, tot, callback););
+		EVAL_STAT_ADD(EVAL_STAT_EVAL_OUTS, evals, choose(StdDeck_N_CARDS - maskCount(dead), i));
+		EVAL_STAT_ADD(EVAL_STAT_EVAL_OUTS, combos, choose(StdDeck_N_CARDS - maskCount(dead), i));
+		EVAL_STAT_END(EVAL_STAT_EVAL_OUTS, stat);
 		return 1;
 }
 
+/*
+ * Walks every way of completing the board in increasing card order.  Each
+ * partial board is a prefix of exactly one path, so evaluating at the
+ * depths where the board has 3, 4 and 5 cards counts every flop, turn and
+ * river exactly once, all in one enumeration.
+ */
+typedef struct {
+	StdDeck_CardMask dead;
+	int nboard;
+	int ourtype;
+	/* the evaluators for our hand on the flop, turn and river */
+	EvalTypeFn evaltype[3];
+	OutsResult *res;
+} OutsWalk;
+
+static void outsWalk(OutsWalk *w, StdDeck_CardMask cards, int next, int depth) {
+	int size = w->nboard + depth;
+	int c, type;
+
+	if (depth > 0 && size >= 3) {
+		type = w->evaltype[size - 3](cards);
+		w->res->counts[size - 3][type] += 1;
+		w->res->totals[size - 3] += 1;
+		if (depth == 1 && type > w->ourtype) {
+			StdDeck_CardMask_OR(w->res->outs, w->res->outs, StdDeck_MASK(next - 1));
+			w->res->nouts += 1;
+		}
+	}
+	if (size >= 5)
+		return;
+
+	for (c = next; c < StdDeck_N_CARDS; c++) {
+		StdDeck_CardMask more;
+
+		if (StdDeck_CardMask_CARD_IS_SET(w->dead, c))
+			continue;
+		StdDeck_CardMask_OR(more, cards, StdDeck_MASK(c));
+		outsWalk(w, more, c + 1, depth + 1);
+	}
+}
+
+/*
+ * Histogram of our hand type on each later street, plus the single next
+ * cards that improve our hand type (only once the flop is out).
+ */
+OutsResult evalOutsAll(StdDeck_CardMask pocket, StdDeck_CardMask board) {
+	OutsResult res;
+	OutsWalk w;
+	StdDeck_CardMask cards;
+	EVAL_STAT_BEGIN(stat);
+
+	memset(&res, 0, sizeof res);
+	StdDeck_CardMask_RESET(res.outs);
+	StdDeck_CardMask_OR(cards, pocket, board);
+	w.dead = cards;
+	w.nboard = StdDeck_numCards(board);
+	w.ourtype = w.nboard >= 3 ? StdDeck_StdRules_EVAL_TYPE(cards, 2 + w.nboard) : StdRules_HandType_LAST + 1;
+	w.evaltype[0] = evalType5;
+	w.evaltype[1] = evalType6;
+	w.evaltype[2] = evalType7;
+	w.res = &res;
+	if (w.nboard <= 5)
+		outsWalk(&w, cards, 0, 0);
+	EVAL_STAT_ADD(EVAL_STAT_EVAL_OUTS, evals, res.totals[0] + res.totals[1] + res.totals[2] + (w.nboard >= 3));
+	EVAL_STAT_ADD(EVAL_STAT_EVAL_OUTS, combos, res.totals[0] + res.totals[1] + res.totals[2]);
+	EVAL_STAT_END(EVAL_STAT_EVAL_OUTS, stat);
+	return res;
+}
+
+/*
+ * Monte Carlo deals against num_opponents random hands.  Each deal is the
+ * rest of the board and the opponents' hole cards, taken with a partial
+ * Fisher-Yates shuffle of the live cards from position first on, so
+ * nothing is rejected and nothing is allocated inside the loop.  The live
+ * array is left as some permutation of itself, which is all the next deal
+ * needs.
+ */
+typedef struct {
+	StdDeck_CardMask pocket;
+	StdDeck_CardMask board;
+	int live[StdDeck_N_CARDS];
+	int nlive, nrunout, need;
+} McDeal;
+
+static int mcDealInit(McDeal *d, StdDeck_CardMask pocket, StdDeck_CardMask board, int num_opponents) {
+	StdDeck_CardMask dead;
+	int i;
+
+	StdDeck_CardMask_OR(dead, pocket, board);
+	d->pocket = pocket;
+	d->board = board;
+	d->nlive = 0;
+	for (i = 0; i < StdDeck_N_CARDS; i++) {
+		if (!StdDeck_CardMask_CARD_IS_SET(dead, i))
+			d->live[d->nlive++] = i;
+	}
+	d->nrunout = 5 - StdDeck_numCards(board);
+	d->need = d->nrunout + 2 * num_opponents;
+	return num_opponents >= 1 && d->nrunout >= 0 && d->need <= d->nlive;
+}
+
+/* One deal: 2 if we are ahead of every opponent, 1 if tied with the best
+ * of them and 0 if behind */
+static int mcDealOne(McDeal *d, PokerRand *rng, int first) {
+	StdDeck_CardMask ours, opp, runout;
+	HandVal ourscore, oppscore, best;
+	int k, j, t;
+
+	for (k = first; k < d->need; k++) {
+		j = k + pokerRandBelow(rng, d->nlive - k);
+		t = d->live[k];
+		d->live[k] = d->live[j];
+		d->live[j] = t;
+	}
+
+	StdDeck_CardMask_RESET(runout);
+	for (k = 0; k < d->nrunout; k++) {
+		StdDeck_CardMask_OR(runout, runout, StdDeck_MASK(d->live[k]));
+	}
+	StdDeck_CardMask_OR(runout, runout, d->board);
+	StdDeck_CardMask_OR(ours, d->pocket, runout);
+	ourscore = evalN7(ours);
+
+	best = 0;
+	for (k = d->nrunout; k < d->need; k += 2) {
+		StdDeck_CardMask_OR(opp, StdDeck_MASK(d->live[k]), StdDeck_MASK(d->live[k + 1]));
+		StdDeck_CardMask_OR(opp, opp, runout);
+		oppscore = evalN7(opp);
+		if (oppscore > best)
+			best = oppscore;
+	}
+
+	return ourscore > best ? 2 : ourscore == best;
+}
+
+/* Monte Carlo equity of a pocket against num_opponents random hands */
+EquityTally monteCarloEquity(StdDeck_CardMask pocket, StdDeck_CardMask board, int num_opponents, int iterations, uint64 seed) {
+	EquityTally tally = { 0, 0, 0 };
+	McDeal deal;
+	PokerRand rng;
+	int i, res;
+
+	if (!mcDealInit(&deal, pocket, board, num_opponents))
+		return tally;
+
+	pokerRandSeed(&rng, seed);
+
+	for (i = 0; i < iterations; i++) {
+		res = mcDealOne(&deal, &rng, 0);
+		if (res == 2)
+			tally.ahead += 1;
+		else if (res == 1)
+			tally.tied += 1;
+		else
+			tally.behind += 1;
+	}
+
+	return tally;
+}
+
+/*
+ * Monte Carlo equity that samples until the estimate is good enough rather
+ * than for a fixed count: until its standard error is at most target_se,
+ * deadline_ms have passed or max_samples deals are done, whichever comes
+ * first.  A target or deadline of 0 is not used.  Ties score 1/2, as in
+ * get_equity.
+ *
+ * Stratified sampling deals the first card, the next board card or on the
+ * river the first opponent card, from each live card in turn, so every
+ * pass over them draws it in its exact proportions and only the rest of
+ * the deal varies.  The passes are independent, so the error comes from
+ * the spread of their means, and max_samples is rounded down to whole
+ * passes; if it is less than one, the deals are sampled plainly.  Plain
+ * sampling takes the spread of the deals.
+ *
+ * The checks are made every MC_CHECK deals or pass, and never before
+ * MC_MIN_SAMPLES deals.  While every deal has scored the same the spread
+ * is 0, so the error is taken as that of a proportion with one deal of
+ * each score added, as in the Agresti-Coull interval.
+ */
+#define MC_CHECK 64
+#define MC_MIN_SAMPLES 256
+#define MC_Z95 1.959963984540054
+
+static double mcElapsedMs(const struct timespec *start) {
+	struct timespec now;
+
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return (now.tv_sec - start->tv_sec) * 1e3 + (now.tv_nsec - start->tv_nsec) / 1e6;
+}
+
+EquityEstimate monteCarloEquityAdaptive(StdDeck_CardMask pocket, StdDeck_CardMask board, int num_opponents,
+		double target_se, double deadline_ms, int max_samples, int stratified, uint64 seed) {
+	EquityEstimate est = { -1, 0, 0, 0, 0 };
+	McDeal deal;
+	PokerRand rng;
+	struct timespec start;
+	int order[StdDeck_N_CARDS];
+	/* running mean and sum of squared deviations of the deals, or of the
+	 * pass means when stratified */
+	double mean = 0, m2 = 0, x, delta, se = 0;
+	int n = 0, samples = 0, i, s, t;
+
+	if (max_samples <= 0 || !mcDealInit(&deal, pocket, board, num_opponents))
+		return est;
+	/* too few samples for one pass: sample plainly */
+	if (max_samples < deal.nlive)
+		stratified = 0;
+	memcpy(order, deal.live, sizeof order);
+	pokerRandSeed(&rng, seed);
+	clock_gettime(CLOCK_MONOTONIC, &start);
+
+	while (samples < max_samples) {
+		if (stratified) {
+			if (samples + deal.nlive > max_samples)
+				break;
+			x = 0;
+			for (s = 0; s < deal.nlive; s++) {
+				/* deal order[s] first, and the rest at random */
+				for (i = 0; deal.live[i] != order[s]; i++)
+					;
+				t = deal.live[0];
+				deal.live[0] = deal.live[i];
+				deal.live[i] = t;
+				x += mcDealOne(&deal, &rng, 1) / 2.0;
+			}
+			x /= deal.nlive;
+			samples += deal.nlive;
+			n++;
+			delta = x - mean;
+			mean += delta / n;
+			m2 += delta * (x - mean);
+		}
+		else {
+			for (i = 0; i < MC_CHECK && samples < max_samples; i++) {
+				x = mcDealOne(&deal, &rng, 0) / 2.0;
+				samples++;
+				n++;
+				delta = x - mean;
+				mean += delta / n;
+				m2 += delta * (x - mean);
+			}
+		}
+		if (m2 > 0)
+			se = sqrt(m2 / (n - 1) / n);
+		else {
+			x = (mean * samples + 1) / (samples + 2);
+			se = sqrt(x * (1 - x) / samples);
+		}
+		if (samples >= MC_MIN_SAMPLES && ((target_se > 0 && se <= target_se)
+				|| (deadline_ms > 0 && mcElapsedMs(&start) >= deadline_ms)))
+			break;
+	}
+	if (samples == 0)
+		return est;
+
+	est.equity = mean;
+	est.std_error = se;
+	est.low = mean - MC_Z95 * se < 0 ? 0 : mean - MC_Z95 * se;
+	est.high = mean + MC_Z95 * se > 1 ? 1 : mean + MC_Z95 * se;
+	est.samples = samples;
+	return est;
+}
 
 /*
  * When run over seven cards, here are the distribution of hands:
@@ -581,27 +2131,33 @@ int wrap_StdDeck_CardMask_EQUAL(StdDeck_CardMask mask1, StdDeck_CardMask mask2)
 StdDeck_CardMask TextToPokerEval(char* strHand)
 {
     StdDeck_CardMask theHand, theCard;
+    EVAL_STAT_BEGIN(stat);
     StdDeck_CardMask_RESET(theHand);
 
     if (strHand && strlen(strHand))
     {
-        int cardIndex = -1;
+        int cardIndex;
         char* curCard = strHand;
-        while (*curCard)
+        while (curCard[0] && curCard[1])
         {
-            // Take the card text and convert it to an index (0..51)
-            StdDeck_stringToCard(curCard, &cardIndex);
-            // Convert the card index to a mask
-            theCard = StdDeck_MASK(cardIndex);
-            // Add the card (mask) to the hand
-            StdDeck_CardMask_OR(theHand, theHand, theCard);
+            // Take the card text and convert it to an index (0..51),
+            // skipping text that isn't a card
+            if (StdDeck_stringToCard(curCard, &cardIndex) == 2)
+            {
+                // Convert the card index to a mask
+                theCard = StdDeck_MASK(cardIndex);
+                // Add the card (mask) to the hand
+                StdDeck_CardMask_OR(theHand, theHand, theCard);
+            }
             // Advance to the next card (if any)
             curCard += 2;
         }
     }
+    EVAL_STAT_END(EVAL_STAT_PARSE, stat);
     return theHand;
 }
 
+/* The mask is the caller's, to release with freeCardMask */
 StdDeck_CardMask *TextToPtr(char* strHand) {
 	StdDeck_CardMask theHand = TextToPokerEval(strHand);
 	StdDeck_CardMask *ptr = malloc(sizeof *ptr);
@@ -609,4 +2165,31 @@ StdDeck_CardMask *TextToPtr(char* strHand) {
 	return ptr;
 }
 
+void freeCardMask(StdDeck_CardMask *ptr) {
+	free(ptr);
+}
+
+/*
+ * The cards of m as text, highest card first like StdDeck_maskString but
+ * with no spaces, written to the caller's buffer of size bytes rather than
+ * a static one.  Returns the length, or -1 if it doesn't fit.
+ */
+int maskToText(StdDeck_CardMask m, char *buf, int size) {
+	static const char ranks[] = "23456789TJQKA", suits[] = "hdcs";
+	int i, n = 0;
+
+	for (i = StdDeck_N_CARDS - 1; i >= 0; i--) {
+		if (!StdDeck_CardMask_CARD_IS_SET(m, i))
+			continue;
+		if (n + 2 >= size)
+			return -1;
+		buf[n++] = ranks[StdDeck_RANK(i)];
+		buf[n++] = suits[StdDeck_SUIT(i)];
+	}
+	if (size < 1)
+		return -1;
+	buf[n] = '\0';
+	return n;
+}
+
 
@@ -1,5 +1,18 @@
 StdDeck_CardMask *TextToPtr(char*);
 StdDeck_CardMask TextToPokerEval(char*);
+void freeCardMask(StdDeck_CardMask *ptr);
+int maskToText(StdDeck_CardMask m, char *buf, int size);
+int cardsToMask(const uint8 *cards, int n, StdDeck_CardMask *out);
+
+/* The number of cards in a mask, for the entry points that take masks */
+static inline int maskCount(StdDeck_CardMask m) {
+	return __builtin_popcountll(m.cards_n);
+}
+
+HandVal Eval_Mask_N(StdDeck_CardMask cards);
+int Eval_Mask_Type(StdDeck_CardMask cards);
+int scoreTwoCardsMask(StdDeck_CardMask pocket, StdDeck_CardMask board, void *callback(int, StdDeck_CardMask));
+int evalOutsMask(StdDeck_CardMask pocket, StdDeck_CardMask board, int totboard, void *callback(int, StdDeck_CardMask));
 int 
 StdDeck_StdRules_EVAL_TYPE( StdDeck_CardMask, int);
 void evalSingleType(StdDeck_CardMask player, StdDeck_CardMask board, int tot, void *callback(int, StdDeck_CardMask));
@@ -7,3 +20,439 @@ typedef struct {
 	float ppot;
 	float npot;
 } HandPotential;
+
+typedef struct {
+	int ahead;
+	int tied;
+	int behind;
+} EquityTally;
+
+/* xorshift64* generator, seeded through splitmix64 so that any seed
+ * (including 0) gives a usable state */
+typedef struct {
+	uint64 s;
+} PokerRand;
+
+static inline void pokerRandSeed(PokerRand *r, uint64 seed) {
+	uint64 z = seed + 0x9E3779B97F4A7C15ULL;
+	z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+	z = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+	z ^= z >> 31;
+	r->s = z ? z : 0x9E3779B97F4A7C15ULL;
+}
+
+static inline uint64 pokerRandNext(PokerRand *r) {
+	r->s ^= r->s >> 12;
+	r->s ^= r->s << 25;
+	r->s ^= r->s >> 27;
+	return r->s * 0x2545F4914F6CDD1DULL;
+}
+
+/* Uniform integer in [0, n), using the top 32 bits of the output */
+static inline int pokerRandBelow(PokerRand *r, int n) {
+	return (int) (((pokerRandNext(r) >> 32) * (uint64) n) >> 32);
+}
+
+/* Position of the hole cards {hi, lo}, hi > lo, in the dense ordering of
+ * all N_COMBOS two-card combinations */
+#define N_COMBOS 1326
+#define COMBO_INDEX(hi, lo) ((hi) * ((hi) - 1) / 2 + (lo))
+
+double handStrength(StdDeck_CardMask us, StdDeck_CardMask board);
+HandPotential handPotentialMask(StdDeck_CardMask pocket, StdDeck_CardMask board, int maxcards);
+double handStrengthWeighted(StdDeck_CardMask us, StdDeck_CardMask board, const float *weights);
+
+typedef struct {
+	double equity;
+	int exact;
+	int runouts;
+} RangeEquity;
+
+RangeEquity rangeEquity(const float *hero, const float *villain, StdDeck_CardMask board,
+		int max_work, int samples, uint64 seed, double *combo_equity);
+
+#define MW_MAX_OPPONENTS 4
+
+typedef struct {
+	double win;
+	double tie;
+	double lose;
+	double equity;
+} MultiwayEquity;
+
+MultiwayEquity multiwayEquity(StdDeck_CardMask pocket, StdDeck_CardMask board, int num_opponents, int to_river);
+void evalBatch(const uint64 *masks, const int *n_cards, HandVal *out, int n);
+void evalTypeBatch(const uint64 *masks, const int *n_cards, int *out, int n);
+/* counts and totals are indexed by street: flop, turn, river */
+typedef struct {
+	int counts[3][StdRules_HandType_COUNT];
+	int totals[3];
+	StdDeck_CardMask outs;
+	int nouts;
+} OutsResult;
+
+OutsResult evalOutsAll(StdDeck_CardMask pocket, StdDeck_CardMask board);
+int scoreTwoCardsInto(StdDeck_CardMask pocket, StdDeck_CardMask board, HandVal *scores);
+EquityTally monteCarloEquity(StdDeck_CardMask pocket, StdDeck_CardMask board, int num_opponents, int iterations, uint64 seed);
+
+typedef struct {
+	double equity;
+	double std_error;
+	/* the 95% confidence interval */
+	double low;
+	double high;
+	int samples;
+} EquityEstimate;
+
+EquityEstimate monteCarloEquityAdaptive(StdDeck_CardMask pocket, StdDeck_CardMask board, int num_opponents,
+		double target_se, double deadline_ms, int max_samples, int stratified, uint64 seed);
+
+/* A deck of the cards left, dealing random layouts of sets; see deck.c */
+typedef struct PokerDeck PokerDeck;
+
+PokerDeck *deckNew(StdDeck_CardMask dead, uint64 seed);
+void deckFree(PokerDeck *deck);
+void deckSeed(PokerDeck *deck, uint64 seed);
+void deckSetDead(PokerDeck *deck, StdDeck_CardMask dead);
+int deckLiveCount(const PokerDeck *deck);
+int deckDeal(PokerDeck *deck, const int *sizes, int nsets, uint64 *out, int iterations);
+
+typedef void (*PoolFn)(void *arg, int item);
+
+typedef struct PoolBatch {
+	PoolFn fn;
+	void *arg;
+	int nitems;
+	int next;
+	int done;
+	struct PoolBatch *link;
+} PoolBatch;
+
+void setThreadCount(int n);
+int getThreadCount(void);
+void poolRun(PoolFn fn, void *arg, int nitems);
+
+/*
+ * Background jobs; see jobs.c.  A kind of job splits its work into chunks:
+ * chunk runs its share of the items of the outer loop, calling jobAdvance
+ * for each, and returns 0 if it stopped because jobCancelled.  estimate
+ * fills result from the chunks with done[chunk] set, finish (if not NULL)
+ * sees the final result and release frees the state.
+ */
+#define JOB_MAX_CHUNKS 64
+#define JOB_RESULTS 4
+
+#define JOB_QUEUED 0
+#define JOB_RUNNING 1
+#define JOB_DONE 2
+#define JOB_CANCELLED 3
+
+typedef struct EvalJob EvalJob;
+
+typedef struct {
+	int (*chunk)(void *state, EvalJob *job, int chunk);
+	void (*estimate)(void *state, const uint8 *done, double *result);
+	void (*finish)(void *state, const double *result);
+	void (*release)(void *state);
+} EvalJobKind;
+
+EvalJob *jobSubmit(const EvalJobKind *kind, void *state, int nchunks, long nitems);
+int jobCancelled(const EvalJob *job);
+void jobAdvance(EvalJob *job, long items);
+int jobState(EvalJob *job);
+double jobProgress(EvalJob *job);
+double jobEstimate(EvalJob *job, double *result);
+void jobCancel(EvalJob *job);
+int jobWait(EvalJob *job, double timeout_ms);
+void jobFree(EvalJob *job);
+
+/* handPotentialMask and multiwayEquity as jobs; result holds ppot and npot,
+ * or win, tie, lose and equity.  NULL for unsupported spots. */
+EvalJob *handPotentialJob(StdDeck_CardMask pocket, StdDeck_CardMask board, int maxcards);
+EvalJob *multiwayEquityJob(StdDeck_CardMask pocket, StdDeck_CardMask board, int num_opponents, int to_river);
+
+/* A group of suit permutations, all of those that exchange suits within
+ * the same class.  pos[s] is suit s's position within its class, lowest
+ * suit first.  perm[k][s] is the image of suit s under the k'th
+ * permutation and cardimg[k][c] the image of card index c. */
+typedef struct {
+	int n;
+	uint8 suitclass[4];
+	uint8 pos[4];
+	uint8 classsize[4];
+	uint8 perm[24][4];
+	uint8 cardimg[24][StdDeck_N_CARDS];
+} SuitGroup;
+
+void setSuitIsomorphism(int on);
+int getSuitIsomorphism(void);
+void suitGroupFixing(SuitGroup *g, StdDeck_CardMask a, StdDeck_CardMask b);
+void suitSubgroupFixing(SuitGroup *h, const SuitGroup *g, const int *cards, int n);
+int suitOrbitWeight(const SuitGroup *g, const int *cards, int n);
+
+/* suitOrbitWeight for a two card hand, for the enumerators' inner loops */
+static inline int suitOrbitWeight2(const SuitGroup *g, int c1, int c2) {
+	int ra = StdDeck_RANK(c1), rb = StdDeck_RANK(c2);
+	int sa = StdDeck_SUIT(c1), sb = StdDeck_SUIT(c2);
+	int m, t;
+
+	if (ra < rb) {
+		t = ra; ra = rb; rb = t;
+		t = sa; sa = sb; sb = t;
+	}
+	if (g->suitclass[sa] != g->suitclass[sb]) {
+		if (g->pos[sa] != 0 || g->pos[sb] != 0)
+			return 0;
+		return g->classsize[sa] * g->classsize[sb];
+	}
+	m = g->classsize[sa];
+	if (sa == sb)
+		return g->pos[sa] == 0 ? m : 0;
+	if (ra == rb) {
+		/* a pair within one class: the two lowest suits, in either order */
+		if (g->pos[sa] + g->pos[sb] != 1)
+			return 0;
+		return m * (m - 1) / 2;
+	}
+	if (g->pos[sa] != 0 || g->pos[sb] != 1)
+		return 0;
+	return m * (m - 1);
+}
+
+HandVal StdDeck_StdRules_EVAL_N(StdDeck_CardMask cards, int n_cards);
+
+/*
+ * Lookup table evaluator.  The table file, written by tools/mkevaltab,
+ * starts with an EvalTableHeader followed by
+ *
+ *   uint32  suitkey[8192]   sum of the rank keys of a suit's rank mask
+ *   uint32  disp[nrows]     row displacements of the perfect hash
+ *   HandVal ranks[nranks]   value of each rank multiset, by hashed key
+ *   HandVal flush[8192]     value of a flush with the given rank mask, or 0
+ *
+ * A hand with no flush is valued by its ranks alone.  Their key sums are
+ * distinct for every multiset of up to 7 cards, so (sum << 3 | n_cards)
+ * identifies one, and the displacement table packs those keys densely.
+ */
+#define EVALTAB_MAGIC "PEVTAB01"
+#define EVALTAB_MAX_CARDS 7
+
+typedef struct {
+	char magic[8];
+	uint32 rowshift;
+	uint32 nrows;
+	uint32 nranks;
+	uint32 reserved;
+} EvalTableHeader;
+
+typedef struct {
+	const uint32 *suitkey;
+	const uint32 *disp;
+	const HandVal *ranks;
+	const HandVal *flush;
+	uint32 rowshift;
+	uint32 rowmask;
+} EvalTable;
+
+int evalTableLoad(const char *path);
+int evalTableLoaded(void);
+void setTableEval(int on);
+int getTableEval(void);
+const EvalTable *evalTable(void);
+
+/* StdDeck_StdRules_EVAL_N, through the table when t is not NULL */
+static inline HandVal evalTableN(const EvalTable *t, StdDeck_CardMask cards, int n_cards) {
+	uint32 ss, sc, sd, sh, key;
+	HandVal flush;
+
+	if (t == NULL || n_cards > EVALTAB_MAX_CARDS)
+		return StdDeck_StdRules_EVAL_N(cards, n_cards);
+	ss = StdDeck_CardMask_SPADES(cards);
+	sc = StdDeck_CardMask_CLUBS(cards);
+	sd = StdDeck_CardMask_DIAMONDS(cards);
+	sh = StdDeck_CardMask_HEARTS(cards);
+	/* with 7 cards at most one suit can hold a flush, and nothing else beats it */
+	flush = t->flush[ss] | t->flush[sc] | t->flush[sd] | t->flush[sh];
+	if (flush)
+		return flush;
+	key = ((t->suitkey[ss] + t->suitkey[sc] + t->suitkey[sd] + t->suitkey[sh]) << 3) | n_cards;
+	return t->ranks[t->disp[key >> t->rowshift] + (key & t->rowmask)];
+}
+
+/* Evaluators for a fixed number of cards; see evalsized.c */
+typedef HandVal (*EvalNFn)(StdDeck_CardMask cards);
+typedef int (*EvalTypeFn)(StdDeck_CardMask cards);
+
+HandVal evalN5(StdDeck_CardMask cards);
+HandVal evalN6(StdDeck_CardMask cards);
+HandVal evalN7(StdDeck_CardMask cards);
+int evalType5(StdDeck_CardMask cards);
+int evalType6(StdDeck_CardMask cards);
+int evalType7(StdDeck_CardMask cards);
+EvalNFn evalNSized(int n_cards);
+EvalTypeFn evalTypeSized(int n_cards);
+
+/* evalTableN, with eval the evaluator evalNSized gave for n_cards */
+static inline HandVal evalTableSized(const EvalTable *t, EvalNFn eval, StdDeck_CardMask cards, int n_cards) {
+	if (t == NULL && eval != NULL)
+		return eval(cards);
+	return evalTableN(t, cards, n_cards);
+}
+
+/* SIMD evaluator; see simd.c */
+#define EVAL_X8 8
+
+void evalX8(const StdDeck_CardMask *cards, int n_cards, HandVal *out);
+void evalTypeX8(const StdDeck_CardMask *cards, int n_cards, int *out);
+void setSimdEval(int on);
+int getSimdEval(void);
+const char *simdEvalPath(void);
+void evalBlock(const EvalTable *t, const StdDeck_CardMask *cards, int n_cards, HandVal *out, int count);
+
+/*
+ * Preflop equity tables.  The file, written by tools/mkpreflop, starts with
+ * a PreflopTableHeader followed by
+ *
+ *   uint32 combos[1326][1326]  2 * wins + ties of one hand against another
+ *                              over every board, or 0 if they share a card
+ *   double classes[169][169]   equity of one hand class against another
+ *   double random[169]         equity of a hand class against a random hand
+ *
+ * Hands are indexed by COMBO_INDEX.  Of the classes, a pair of rank r is
+ * r * 13 + r, suited hi, lo is hi * 13 + lo and offsuit hi, lo is lo * 13 + hi.
+ */
+#define PREFLOP_MAGIC "PEPRE001"
+#define PREFLOP_CLASSES 169
+#define PREFLOP_BOARDS 1712304
+
+typedef struct {
+	char magic[8];
+	uint32 ncombos;
+	uint32 nclasses;
+	uint32 nboards;
+	uint32 reserved;
+} PreflopTableHeader;
+
+int preflopTableLoad(const char *path);
+int preflopTableLoaded(void);
+int preflopClass(StdDeck_CardMask pocket);
+uint32 preflopMatchup(const EvalTable *t, StdDeck_CardMask a, StdDeck_CardMask b);
+double preflopEquity(StdDeck_CardMask a, StdDeck_CardMask b);
+double preflopEquityVsRandom(StdDeck_CardMask pocket);
+double preflopClassEquity(int a, int b);
+double preflopClassEquityVsRandom(int c);
+
+/* Results cache for handStrength and handPotential; see spotcache.c */
+#define SPOT_HS 1
+#define SPOT_HP 2
+#define SPOT_HP7 3
+
+typedef struct {
+	uint64 hits;
+	uint64 shared_hits;
+	uint64 misses;
+	uint64 inserts;
+	uint64 evictions;
+	long size;
+	long used;
+	long shared_size;
+	long shared_used;
+} SpotCacheStats;
+
+uint64 spotKey(StdDeck_CardMask pocket, StdDeck_CardMask board, int kind);
+int spotCanonical(StdDeck_CardMask pocket, StdDeck_CardMask board);
+int spotCacheGet(uint64 key, double *v0, double *v1);
+void spotCachePut(uint64 key, double v0, double v1);
+int spotCacheSetSize(long entries);
+long spotCacheSize(void);
+int spotCacheOpen(const char *path, long entries);
+void spotCacheClose(void);
+void spotCacheClear(void);
+SpotCacheStats spotCacheStats(void);
+void spotCacheResetStats(void);
+long spotCachePrewarm(StdDeck_CardMask pocket, int kinds);
+
+/* Hand strength distributions over runouts, for card abstraction; see
+ * hsdist.c.  The feature file written by hsFeaturesWrite is an
+ * HsFeatureHeader followed by nspots records of
+ *
+ *   uint64 pocket, board     the spot's cards_n, the least image of its suits
+ *   float  ehs, ehs2         E[HS] and E[HS^2] over every river
+ *   float  hist[nbuckets]    the fraction of rivers with HS in each bucket
+ */
+#define HSFEAT_MAGIC "PEHSF001"
+
+typedef struct {
+	double ehs;
+	double ehs2;
+	int runouts;
+} HsDistribution;
+
+typedef struct {
+	char magic[8];
+	uint32 nboard;
+	uint32 nbuckets;
+	uint64 nspots;
+} HsFeatureHeader;
+
+HsDistribution hsDistribution(StdDeck_CardMask pocket, StdDeck_CardMask board, int nbuckets, double *hist);
+long hsFeaturesWrite(const char *path, int nboard, int nbuckets);
+
+/* Hand range notation; see ranges.c */
+int rangeParse(const char *text, StdDeck_CardMask dead, float *weights);
+int rangeMasks(const float *weights, uint64 *masks, float *mask_weights);
+void rangeCacheClear(void);
+
+/*
+ * Instrumentation of the entry points, compiled in with -DPOKEREVAL_STATS
+ * (extconf's --enable-stats); see stats.c.  Each entry point counts its
+ * calls, the hands it evaluates and the combinations (opponent hands,
+ * runouts, or both) it covers, and the time spent in it and in callbacks.
+ * Without POKEREVAL_STATS the hooks below expand to nothing.
+ */
+#define EVAL_STAT_HAND_STRENGTH 0
+#define EVAL_STAT_HAND_POTENTIAL 1
+#define EVAL_STAT_SCORE_TWO_CARDS 2
+#define EVAL_STAT_EVAL_OUTS 3
+#define EVAL_STAT_PARSE 4
+#define EVAL_STAT_ENTRIES 5
+
+typedef struct {
+	uint64 calls;
+	uint64 evals;
+	uint64 combos;
+	uint64 ns;
+	uint64 cycles;
+	uint64 callback_ns;
+} EvalStatCounters;
+
+int evalStatsRead(EvalStatCounters *out);
+void evalStatsReset(void);
+
+#ifdef POKEREVAL_STATS
+EvalStatCounters *evalStatsThread(void);
+uint64 evalStatsNs(void);
+uint64 evalStatsCycles(void);
+
+/* Only the owning thread writes its counters, so a relaxed store will do */
+#define EVAL_STAT_ADD(entry, field, n) do { \
+		uint64 *stat_p = &evalStatsThread()[entry].field; \
+		__atomic_store_n(stat_p, *stat_p + (n), __ATOMIC_RELAXED); \
+	} while (0)
+#define EVAL_STAT_BEGIN(t) uint64 t##_ns = evalStatsNs(), t##_cycles = evalStatsCycles()
+#define EVAL_STAT_END(entry, t) do { \
+		EVAL_STAT_ADD(entry, cycles, evalStatsCycles() - t##_cycles); \
+		EVAL_STAT_ADD(entry, ns, evalStatsNs() - t##_ns); \
+		EVAL_STAT_ADD(entry, calls, 1); \
+	} while (0)
+#define EVAL_STAT_CALLBACK(entry, call) do { \
+		uint64 stat_cb = evalStatsNs(); \
+		call; \
+		EVAL_STAT_ADD(entry, callback_ns, evalStatsNs() - stat_cb); \
+	} while (0)
+#else
+#define EVAL_STAT_ADD(entry, field, n) do { } while (0)
+#define EVAL_STAT_BEGIN(t) do { } while (0)
+#define EVAL_STAT_END(entry, t) do { } while (0)
+#define EVAL_STAT_CALLBACK(entry, call) call
+#endif
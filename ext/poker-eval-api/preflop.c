@@ -0,0 +1,211 @@
+#include "poker-eval/poker_defs.h"
+#include "poker-eval-api.h"
+#include <fcntl.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+/*
+ * Preflop all-in equities never change, so tools/mkpreflop enumerates them
+ * once, for every pair of hands, and the table is mapped read-only like the
+ * lookup table evaluator's.  A table stays mapped once loaded.
+ */
+
+typedef struct {
+	const uint32 *combos;
+	const double *classes;
+	const double *random;
+} PreflopTable;
+
+static const PreflopTable *preflop_table = NULL;
+
+/* The two cards of pocket, higher index first.  Returns 0 unless pocket
+ * holds exactly two cards, with any card not found left at -1. */
+static int pocketCards(StdDeck_CardMask pocket, int *hi, int *lo) {
+	int i, n = 0;
+
+	*hi = *lo = -1;
+	for (i = StdDeck_N_CARDS - 1; i >= 0; i--) {
+		if (!StdDeck_CardMask_CARD_IS_SET(pocket, i))
+			continue;
+		if (n == 0)
+			*hi = i;
+		else if (n == 1)
+			*lo = i;
+		n++;
+	}
+	return n == 2;
+}
+
+/* The class of two hole cards, or -1 if pocket isn't two cards */
+int preflopClass(StdDeck_CardMask pocket) {
+	int hi, lo, rhi, rlo, t;
+
+	if (!pocketCards(pocket, &hi, &lo))
+		return -1;
+	rhi = StdDeck_RANK(hi);
+	rlo = StdDeck_RANK(lo);
+	if (rhi < rlo) {
+		t = rhi; rhi = rlo; rlo = t;
+	}
+	if (StdDeck_SUIT(hi) == StdDeck_SUIT(lo))
+		return rhi * StdDeck_Rank_COUNT + rlo;
+	return rlo * StdDeck_Rank_COUNT + rhi;
+}
+
+/*
+ * 2 * wins + ties of hand a against hand b over all PREFLOP_BOARDS boards,
+ * evaluating through t if it is not NULL.  a and b must not share a card.
+ */
+uint32 preflopMatchup(const EvalTable *t, StdDeck_CardMask a, StdDeck_CardMask b) {
+	StdDeck_CardMask dead, live[StdDeck_N_CARDS];
+	StdDeck_CardMask b1, b2, b3, b4, board, cards;
+	HandVal va, vb;
+	int n = 0, i1, i2, i3, i4, i5;
+	uint32 score = 0;
+
+	StdDeck_CardMask_OR(dead, a, b);
+	for (i1 = 0; i1 < StdDeck_N_CARDS; i1++)
+		if (!StdDeck_CardMask_CARD_IS_SET(dead, i1))
+			live[n++] = StdDeck_MASK(i1);
+
+	for (i1 = 0; i1 < n; i1++) {
+		b1 = live[i1];
+		for (i2 = i1 + 1; i2 < n; i2++) {
+			StdDeck_CardMask_OR(b2, b1, live[i2]);
+			for (i3 = i2 + 1; i3 < n; i3++) {
+				StdDeck_CardMask_OR(b3, b2, live[i3]);
+				for (i4 = i3 + 1; i4 < n; i4++) {
+					StdDeck_CardMask_OR(b4, b3, live[i4]);
+					for (i5 = i4 + 1; i5 < n; i5++) {
+						StdDeck_CardMask_OR(board, b4, live[i5]);
+						StdDeck_CardMask_OR(cards, a, board);
+						va = evalTableSized(t, evalN7, cards, 7);
+						StdDeck_CardMask_OR(cards, b, board);
+						vb = evalTableSized(t, evalN7, cards, 7);
+						score += va > vb ? 2 : va == vb;
+					}
+				}
+			}
+		}
+	}
+	return score;
+}
+
+/* Checks the table's invariants on a sample of matchups, and recomputes
+ * one of them */
+static int preflopTableCheck(const PreflopTable *p) {
+	PokerRand rand;
+	int i, a, b, hi = 0, lo = 0;
+	StdDeck_CardMask ma, mb;
+
+	pokerRandSeed(&rand, 0);
+	for (i = 0; i < 1000; i++) {
+		a = pokerRandBelow(&rand, N_COMBOS);
+		b = pokerRandBelow(&rand, N_COMBOS);
+		if ((uint64) p->combos[a * N_COMBOS + b] + p->combos[b * N_COMBOS + a] != 2 * PREFLOP_BOARDS
+				&& (p->combos[a * N_COMBOS + b] != 0 || p->combos[b * N_COMBOS + a] != 0))
+			return 0;
+	}
+
+	do {
+		StdDeck_CardMask_RESET(ma);
+		StdDeck_CardMask_RESET(mb);
+		while (StdDeck_numCards(ma) < 2)
+			StdDeck_CardMask_SET(ma, pokerRandBelow(&rand, StdDeck_N_CARDS));
+		while (StdDeck_numCards(mb) < 2)
+			StdDeck_CardMask_SET(mb, pokerRandBelow(&rand, StdDeck_N_CARDS));
+	} while (StdDeck_CardMask_ANY_SET(ma, mb));
+	pocketCards(ma, &hi, &lo);
+	a = COMBO_INDEX(hi, lo);
+	pocketCards(mb, &hi, &lo);
+	b = COMBO_INDEX(hi, lo);
+	return p->combos[a * N_COMBOS + b] == preflopMatchup(evalTable(), ma, mb);
+}
+
+/*
+ * Maps the preflop table at path.  Returns 1 on success, or 0 if the file
+ * can't be read, isn't a preflop table or fails the check.
+ */
+int preflopTableLoad(const char *path) {
+	const PreflopTableHeader *h;
+	PreflopTable p, *loaded;
+	struct stat st;
+	size_t size;
+	void *map;
+	int fd;
+
+	fd = open(path, O_RDONLY);
+	if (fd < 0)
+		return 0;
+	if (fstat(fd, &st) != 0 || st.st_size < (off_t) sizeof(PreflopTableHeader)) {
+		close(fd);
+		return 0;
+	}
+	size = st.st_size;
+	map = mmap(NULL, size, PROT_READ, MAP_SHARED, fd, 0);
+	close(fd);
+	if (map == MAP_FAILED)
+		return 0;
+
+	h = map;
+	if (memcmp(h->magic, PREFLOP_MAGIC, sizeof h->magic) != 0 || h->ncombos != N_COMBOS
+			|| h->nclasses != PREFLOP_CLASSES || h->nboards != PREFLOP_BOARDS
+			|| size != sizeof(PreflopTableHeader) + sizeof(uint32) * N_COMBOS * N_COMBOS
+				+ sizeof(double) * (PREFLOP_CLASSES * PREFLOP_CLASSES + PREFLOP_CLASSES)) {
+		munmap(map, size);
+		return 0;
+	}
+	p.combos = (const uint32 *) (h + 1);
+	p.classes = (const double *) (p.combos + N_COMBOS * N_COMBOS);
+	p.random = p.classes + PREFLOP_CLASSES * PREFLOP_CLASSES;
+
+	if (!preflopTableCheck(&p) || (loaded = malloc(sizeof p)) == NULL) {
+		munmap(map, size);
+		return 0;
+	}
+	*loaded = p;
+	preflop_table = loaded;
+	return 1;
+}
+
+int preflopTableLoaded(void) {
+	return preflop_table != NULL;
+}
+
+/* Equity of hole cards a against hole cards b with no board, or -1 if there
+ * is no table or they aren't two distinct hands */
+double preflopEquity(StdDeck_CardMask a, StdDeck_CardMask b) {
+	int ahi, alo, bhi, blo;
+
+	if (preflop_table == NULL || StdDeck_CardMask_ANY_SET(a, b)
+			|| !pocketCards(a, &ahi, &alo) || !pocketCards(b, &bhi, &blo))
+		return -1;
+	return preflop_table->combos[COMBO_INDEX(ahi, alo) * N_COMBOS + COMBO_INDEX(bhi, blo)]
+		/ (2.0 * PREFLOP_BOARDS);
+}
+
+/* Equity of hole cards against a random hand with no board, or -1 */
+double preflopEquityVsRandom(StdDeck_CardMask pocket) {
+	int c = preflopClass(pocket);
+
+	if (c < 0)
+		return -1;
+	return preflopClassEquityVsRandom(c);
+}
+
+/* Equity of class a against class b, averaged over the pairs of hands that
+ * don't share a card, or -1 */
+double preflopClassEquity(int a, int b) {
+	if (preflop_table == NULL || a < 0 || a >= PREFLOP_CLASSES || b < 0 || b >= PREFLOP_CLASSES)
+		return -1;
+	return preflop_table->classes[a * PREFLOP_CLASSES + b];
+}
+
+double preflopClassEquityVsRandom(int c) {
+	if (preflop_table == NULL || c < 0 || c >= PREFLOP_CLASSES)
+		return -1;
+	return preflop_table->random[c];
+}
@@ -0,0 +1,274 @@
+#include "poker-eval/poker_defs.h"
+#include "poker-eval-api.h"
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+
+/*
+ * Hand range notation, compiled to a weight vector indexed by COMBO_INDEX.
+ * A range is a list of items separated by commas or spaces:
+ *
+ *   QQ  QQ+  QQ-88          pairs: one, that one and better, or a span
+ *   AQs AQo AQ              suited, offsuit or both
+ *   AQs+                    the kicker up to one below the top card
+ *   A5s-A2s  76s-54s        a span of kickers, or of connectors with the same gap
+ *   AsKd                    one combination
+ *
+ * and any item may end in ":weight", 1 otherwise.  Later items override
+ * earlier ones, so "AA-22:0.5, AA" weights aces 1 and the other pairs 0.5.
+ *
+ * Compiled ranges are interned in a small direct mapped cache keyed by the
+ * text, before dead cards are taken out, so parsing a range that was seen
+ * recently only costs a hash and a copy.
+ */
+
+#define RANGE_CACHE_SLOTS 256
+
+typedef struct {
+	char *text;
+	float *weights;
+} RangeSlot;
+
+static RangeSlot range_cache[RANGE_CACHE_SLOTS];
+static pthread_mutex_t range_lock = PTHREAD_MUTEX_INITIALIZER;
+
+static int rankOf(char c) {
+	static const char ranks[] = "23456789TJQKA";
+	const char *p;
+
+	if (c >= 'a' && c <= 'z')
+		c -= 'a' - 'A';
+	p = c ? strchr(ranks, c) : NULL;
+	return p ? (int) (p - ranks) : -1;
+}
+
+static int suitOf(char c) {
+	switch (c) {
+	case 'h': case 'H': return StdDeck_Suit_HEARTS;
+	case 'd': case 'D': return StdDeck_Suit_DIAMONDS;
+	case 'c': case 'C': return StdDeck_Suit_CLUBS;
+	case 's': case 'S': return StdDeck_Suit_SPADES;
+	}
+	return -1;
+}
+
+static void setCombo(float *weights, int c1, int c2, float w) {
+	if (c1 < c2)
+		weights[COMBO_INDEX(c2, c1)] = w;
+	else
+		weights[COMBO_INDEX(c1, c2)] = w;
+}
+
+/* Every combination of a hand class; kind is 's', 'o' or 0 for both */
+static void setClass(float *weights, int hi, int lo, int kind, float w) {
+	int s1, s2;
+
+	for (s1 = 0; s1 < 4; s1++)
+		for (s2 = 0; s2 < 4; s2++) {
+			if (hi == lo ? s2 <= s1 : (kind == 's' && s1 != s2) || (kind == 'o' && s1 == s2))
+				continue;
+			setCombo(weights, StdDeck_MAKE_CARD(hi, s1), StdDeck_MAKE_CARD(lo, s2), w);
+		}
+}
+
+/* Reads a hand class such as "AQs", "QQ" or "KJ", highest rank first in hi */
+static const char *parseClass(const char *p, int *hi, int *lo, int *kind) {
+	int a = rankOf(p[0]), b = a < 0 ? -1 : rankOf(p[1]);
+
+	if (b < 0)
+		return NULL;
+	*hi = a > b ? a : b;
+	*lo = a > b ? b : a;
+	*kind = 0;
+	p += 2;
+	if (*p == 's' || *p == 'o') {
+		if (a == b)
+			return NULL;
+		*kind = *p++;
+	}
+	return p;
+}
+
+/* Parses one item, from p up to end, returning 0 if it isn't valid */
+static int parseItem(const char *p, const char *end, float *weights) {
+	const char *colon = memchr(p, ':', end - p);
+	char *wend;
+	float w = 1;
+	int hi, lo, kind, hi2, lo2, kind2, r;
+
+	if (colon) {
+		if (colon + 1 == end)
+			return 0;
+		w = (float) strtod(colon + 1, &wend);
+		if (wend != end || !(w >= 0))
+			return 0;
+		end = colon;
+	}
+
+	if (end - p == 4 && rankOf(p[0]) >= 0 && suitOf(p[1]) >= 0 && rankOf(p[2]) >= 0 && suitOf(p[3]) >= 0) {
+		int c1 = StdDeck_MAKE_CARD(rankOf(p[0]), suitOf(p[1]));
+		int c2 = StdDeck_MAKE_CARD(rankOf(p[2]), suitOf(p[3]));
+		if (c1 == c2)
+			return 0;
+		setCombo(weights, c1, c2, w);
+		return 1;
+	}
+
+	p = parseClass(p, &hi, &lo, &kind);
+	if (p == NULL)
+		return 0;
+	if (p == end) {
+		setClass(weights, hi, lo, kind, w);
+		return 1;
+	}
+
+	if (*p == '+' && p + 1 == end) {
+		if (hi == lo) {
+			for (r = hi; r <= StdDeck_Rank_ACE; r++)
+				setClass(weights, r, r, 0, w);
+		} else {
+			for (r = lo; r < hi; r++)
+				setClass(weights, hi, r, kind, w);
+		}
+		return 1;
+	}
+
+	if (*p != '-')
+		return 0;
+	p = parseClass(p + 1, &hi2, &lo2, &kind2);
+	if (p != end || kind2 != kind || (hi == lo) != (hi2 == lo2))
+		return 0;
+	if (hi < hi2) {
+		r = hi; hi = hi2; hi2 = r;
+		r = lo; lo = lo2; lo2 = r;
+	}
+	if (hi == lo) {
+		for (r = hi2; r <= hi; r++)
+			setClass(weights, r, r, 0, w);
+	} else if (hi == hi2) {
+		if (lo < lo2) {
+			r = lo; lo = lo2; lo2 = r;
+		}
+		for (r = lo2; r <= lo; r++)
+			setClass(weights, hi, r, kind, w);
+	} else if (hi - lo == hi2 - lo2) {
+		for (r = 0; r <= hi - hi2; r++)
+			setClass(weights, hi2 + r, lo2 + r, kind, w);
+	} else {
+		return 0;
+	}
+	return 1;
+}
+
+/* Returns -1 - the offset of the first bad item, or 0 */
+static int compileRange(const char *text, float *weights) {
+	const char *p = text, *start;
+
+	memset(weights, 0, N_COMBOS * sizeof(float));
+	for (;;) {
+		while (*p == ',' || *p == ' ' || *p == '\t' || *p == '\n')
+			p++;
+		if (*p == '\0')
+			return 0;
+		start = p;
+		while (*p && *p != ',' && *p != ' ' && *p != '\t' && *p != '\n')
+			p++;
+		if (!parseItem(start, p, weights))
+			return -1 - (int) (start - text);
+	}
+}
+
+static uint32 rangeHash(const char *text) {
+	uint32 h = 2166136261u;
+
+	while (*text)
+		h = (h ^ (uint8) *text++) * 16777619u;
+	return h;
+}
+
+/*
+ * Compiles a range into weights[N_COMBOS], leaving out every combination
+ * that holds a dead card.  Returns the number of combinations left with
+ * some weight, or -1 - the offset in text of an item that can't be parsed.
+ */
+int rangeParse(const char *text, StdDeck_CardMask dead, float *weights) {
+	RangeSlot *slot = &range_cache[rangeHash(text) & (RANGE_CACHE_SLOTS - 1)];
+	char *copy;
+	float *compiled;
+	int hit = 0, res, c1, c2, live = 0;
+
+	pthread_mutex_lock(&range_lock);
+	if (slot->text && strcmp(slot->text, text) == 0) {
+		memcpy(weights, slot->weights, N_COMBOS * sizeof(float));
+		hit = 1;
+	}
+	pthread_mutex_unlock(&range_lock);
+
+	if (!hit) {
+		res = compileRange(text, weights);
+		if (res < 0)
+			return res;
+		copy = strdup(text);
+		compiled = malloc(N_COMBOS * sizeof(float));
+		if (copy && compiled) {
+			memcpy(compiled, weights, N_COMBOS * sizeof(float));
+			pthread_mutex_lock(&range_lock);
+			free(slot->text);
+			free(slot->weights);
+			slot->text = copy;
+			slot->weights = compiled;
+			pthread_mutex_unlock(&range_lock);
+		} else {
+			free(copy);
+			free(compiled);
+		}
+	}
+
+	for (c1 = 1; c1 < StdDeck_N_CARDS; c1++)
+		for (c2 = 0; c2 < c1; c2++) {
+			float *w = &weights[COMBO_INDEX(c1, c2)];
+			if (*w == 0)
+				continue;
+			if (StdDeck_CardMask_CARD_IS_SET(dead, c1) || StdDeck_CardMask_CARD_IS_SET(dead, c2))
+				*w = 0;
+			else
+				live++;
+		}
+	return live;
+}
+
+/*
+ * Packs the weighted combinations of a weight vector as card masks, in
+ * COMBO_INDEX order, with their weights alongside when mask_weights isn't
+ * NULL.  Both arrays need room for N_COMBOS entries; returns the count.
+ */
+int rangeMasks(const float *weights, uint64 *masks, float *mask_weights) {
+	StdDeck_CardMask m;
+	int c1, c2, n = 0;
+
+	for (c1 = 1; c1 < StdDeck_N_CARDS; c1++)
+		for (c2 = 0; c2 < c1; c2++) {
+			float w = weights[COMBO_INDEX(c1, c2)];
+			if (w <= 0)
+				continue;
+			StdDeck_CardMask_OR(m, StdDeck_MASK(c1), StdDeck_MASK(c2));
+			masks[n] = m.cards_n;
+			if (mask_weights)
+				mask_weights[n] = w;
+			n++;
+		}
+	return n;
+}
+
+void rangeCacheClear(void) {
+	int i;
+
+	pthread_mutex_lock(&range_lock);
+	for (i = 0; i < RANGE_CACHE_SLOTS; i++) {
+		free(range_cache[i].text);
+		free(range_cache[i].weights);
+		range_cache[i].text = NULL;
+		range_cache[i].weights = NULL;
+	}
+	pthread_mutex_unlock(&range_lock);
+}
@@ -0,0 +1,329 @@
+#include "poker-eval/poker_defs.h"
+#include "poker-eval-api.h"
+#include <pthread.h>
+#include <string.h>
+
+/*
+ * StdDeck_StdRules_EVAL_N on EVAL_X8 hands at a time.
+ *
+ * The scalar evaluator branches on the number of duplicate ranks and looks
+ * up nBitsTable, straightTable, topCardTable and topFiveCardsTable.  Here
+ * every case is computed for all lanes and the right one is selected with
+ * masks, and the tables are replaced by arithmetic:
+ *
+ *   - popcounts are the usual shift-and-mask sums,
+ *   - the top card of a rank mask is the exponent of the mask converted
+ *     to float, and 1 << r is the float 2^r converted back,
+ *   - a straight is a run of five bits in the ranks shifted up one with
+ *     the ace copied below the deuce.
+ *
+ * Cases no lane needs are skipped.  The kernel is written once with GCC
+ * vector extensions and compiled for AVX2, SSE4.2 and the baseline
+ * instruction set; the widest one the CPU supports is picked at run time,
+ * after checking it against the scalar evaluator.
+ */
+
+/* The helpers below take and return 32-byte vectors, which has its own
+ * ABI without AVX; they are always inlined, so no call ever uses it */
+#pragma GCC diagnostic ignored "-Wpsabi"
+
+typedef uint64 v8q __attribute__((vector_size(64)));
+typedef uint32 v8u __attribute__((vector_size(32)));
+typedef int32 v8i __attribute__((vector_size(32)));
+typedef float v8f __attribute__((vector_size(32)));
+
+typedef void (*EvalX8Fn)(const StdDeck_CardMask *, int, HandVal *);
+
+#define X8_INLINE static inline __attribute__((always_inline))
+
+X8_INLINE v8u x8Sel(v8i m, v8u a, v8u b) {
+	return (a & (v8u) m) | (b & ~(v8u) m);
+}
+
+X8_INLINE int x8None(v8i m) {
+	m |= __builtin_shuffle(m, (v8i) { 4, 5, 6, 7, 0, 1, 2, 3 });
+	m |= __builtin_shuffle(m, (v8i) { 2, 3, 0, 1, 2, 3, 0, 1 });
+	m |= __builtin_shuffle(m, (v8i) { 1, 0, 1, 0, 1, 0, 1, 0 });
+	return m[0] == 0;
+}
+
+X8_INLINE v8u x8Popcount(v8u x) {
+	x = x - ((x >> 1) & 0x5555);
+	x = (x & 0x3333) + ((x >> 2) & 0x3333);
+	x = (x + (x >> 4)) & 0x0F0F;
+	return (x + (x >> 8)) & 0x1F;
+}
+
+/* Index of the highest set bit, or 0 for an empty mask, as topCardTable */
+X8_INLINE v8u x8TopCard(v8u x) {
+	v8f f = __builtin_convertvector((v8i) x, v8f);
+
+	return (((v8u) f >> 23) - 127) & (v8u) (x != 0);
+}
+
+/* 1 << r */
+X8_INLINE v8u x8Bit(v8u r) {
+	return (v8u) __builtin_convertvector((v8f) ((r + 127) << 23), v8i);
+}
+
+/* The first n fields of topFiveCardsTable */
+X8_INLINE v8u x8TopCards(v8u x, int n) {
+	v8u v = { 0 }, t;
+	int shift;
+
+	for (shift = HandVal_TOP_CARD_SHIFT; n > 0; shift -= HandVal_CARD_WIDTH, n--) {
+		t = x8TopCard(x);
+		v |= t << shift;
+		if (n > 1)
+			x &= ~x8Bit(t);
+	}
+	return v;
+}
+
+/* straightTable: the top card of the highest straight, or 0 */
+X8_INLINE v8u x8Straight(v8u ranks) {
+	v8u r = (ranks << 1) | ((ranks >> StdDeck_Rank_ACE) & 1);
+	v8u s = r & (r >> 1) & (r >> 2) & (r >> 3) & (r >> 4);
+
+	return (x8TopCard(s) + 3) & (v8u) (s != 0);
+}
+
+/* Bit offsets of each suit's ranks in cards_n */
+static int x8_suit_shift[StdDeck_Suit_COUNT];
+
+X8_INLINE v8u x8Suit(v8q m, int suit) {
+	return __builtin_convertvector(m >> x8_suit_shift[suit], v8u) & (StdDeck_N_RANKMASKS - 1);
+}
+
+X8_INLINE void evalX8Kernel(const StdDeck_CardMask *cards, int n_cards, HandVal *out) {
+	v8u ss, sc, sd, sh, ranks, n_dups, two_mask, three_mask, four_mask;
+	v8u flush, st, retval, val, v, t, top, second;
+	v8i has_flush, early, d0, d1, d2;
+	v8q m;
+
+	memcpy(&m, cards, sizeof m);
+	ss = x8Suit(m, StdDeck_Suit_SPADES);
+	sc = x8Suit(m, StdDeck_Suit_CLUBS);
+	sd = x8Suit(m, StdDeck_Suit_DIAMONDS);
+	sh = x8Suit(m, StdDeck_Suit_HEARTS);
+
+	ranks = sc | sd | sh | ss;
+	n_dups = (v8u) { 0 } + (uint32) n_cards - x8Popcount(ranks);
+	two_mask = ranks ^ (sc ^ sd ^ sh ^ ss);
+	three_mask = ((sc & sd) | (sh & ss)) & ((sc & sh) | (sd & ss));
+
+	/* Flushes, in the scalar evaluator's suit order, and straights */
+	flush = x8Sel(x8Popcount(sh) >= 5, sh, (v8u) { 0 });
+	flush = x8Sel(x8Popcount(sd) >= 5, sd, flush);
+	flush = x8Sel(x8Popcount(sc) >= 5, sc, flush);
+	flush = x8Sel(x8Popcount(ss) >= 5, ss, flush);
+	has_flush = flush != 0;
+	retval = (v8u) { 0 };
+	if (!x8None(has_flush)) {
+		st = x8Straight(flush);
+		retval = x8Sel(has_flush,
+			x8Sel(st != 0,
+				HandVal_HANDTYPE_VALUE(StdRules_HandType_STFLUSH) + HandVal_TOP_CARD_VALUE(st),
+				HandVal_HANDTYPE_VALUE(StdRules_HandType_FLUSH) + x8TopCards(flush, 5)),
+			retval);
+	}
+	st = x8Straight(ranks);
+	retval = x8Sel(~has_flush & (st != 0),
+		HandVal_HANDTYPE_VALUE(StdRules_HandType_STRAIGHT) + HandVal_TOP_CARD_VALUE(st), retval);
+	early = (retval != 0) & ((n_dups < 3) | (retval >= HandVal_HANDTYPE_VALUE(StdRules_HandType_STFLUSH)));
+
+	d0 = n_dups == 0;
+	d1 = n_dups == 1;
+	d2 = n_dups == 2;
+
+	/* Three or more duplicates: quads, a full house, the straight or flush,
+	 * or two pair */
+	val = (v8u) { 0 };
+	if (!x8None(~early & ~d0 & ~d1 & ~d2)) {
+		top = x8TopCard(two_mask);
+		second = x8TopCard(two_mask ^ x8Bit(top));
+		val = HandVal_HANDTYPE_VALUE(StdRules_HandType_TWOPAIR) + HandVal_TOP_CARD_VALUE(top)
+			+ HandVal_SECOND_CARD_VALUE(second)
+			+ HandVal_THIRD_CARD_VALUE(x8TopCard(ranks ^ x8Bit(top) ^ x8Bit(second)));
+		val = x8Sel(retval != 0, retval, val);
+		top = x8TopCard(three_mask);
+		v = HandVal_HANDTYPE_VALUE(StdRules_HandType_FULLHOUSE) + HandVal_TOP_CARD_VALUE(top)
+			+ HandVal_SECOND_CARD_VALUE(x8TopCard((two_mask | three_mask) ^ x8Bit(top)));
+		val = x8Sel(x8Popcount(two_mask) != n_dups, v, val);
+		four_mask = sh & sd & sc & ss;
+		top = x8TopCard(four_mask);
+		v = HandVal_HANDTYPE_VALUE(StdRules_HandType_QUADS) + HandVal_TOP_CARD_VALUE(top)
+			+ HandVal_SECOND_CARD_VALUE(x8TopCard(ranks ^ x8Bit(top)));
+		val = x8Sel(four_mask != 0, v, val);
+	}
+
+	/* Two duplicates: two pair or trips */
+	if (!x8None(~early & d2)) {
+		t = x8TopCards(two_mask, 2);
+		v = HandVal_HANDTYPE_VALUE(StdRules_HandType_TWOPAIR) + t
+			+ HandVal_THIRD_CARD_VALUE(x8TopCard(ranks ^ two_mask));
+		top = x8TopCard(three_mask);
+		t = ranks ^ three_mask;
+		second = x8TopCard(t);
+		t ^= x8Bit(second);
+		t = HandVal_HANDTYPE_VALUE(StdRules_HandType_TRIPS) + HandVal_TOP_CARD_VALUE(top)
+			+ HandVal_SECOND_CARD_VALUE(second) + HandVal_THIRD_CARD_VALUE(x8TopCard(t));
+		val = x8Sel(d2, x8Sel(two_mask != 0, v, t), val);
+	}
+
+	/* One pair */
+	if (!x8None(~early & d1)) {
+		t = x8TopCards(ranks ^ two_mask, 3) >> HandVal_CARD_WIDTH;
+		v = HandVal_HANDTYPE_VALUE(StdRules_HandType_ONEPAIR)
+			+ HandVal_TOP_CARD_VALUE(x8TopCard(two_mask)) + t;
+		val = x8Sel(d1, v, val);
+	}
+
+	/* No pair */
+	if (!x8None(~early & d0))
+		val = x8Sel(d0, HandVal_HANDTYPE_VALUE(StdRules_HandType_NOPAIR) + x8TopCards(ranks, 5), val);
+
+	val = x8Sel(early, retval, val);
+	memcpy(out, &val, sizeof val);
+}
+
+static void evalX8Scalar(const StdDeck_CardMask *cards, int n_cards, HandVal *out) {
+	EvalNFn eval = evalNSized(n_cards);
+	int i;
+
+	for (i = 0; i < EVAL_X8; i++)
+		out[i] = evalTableSized(NULL, eval, cards[i], n_cards);
+}
+
+static void evalX8Generic(const StdDeck_CardMask *cards, int n_cards, HandVal *out) {
+	evalX8Kernel(cards, n_cards, out);
+}
+
+#if defined(__x86_64__) || defined(__i386__)
+__attribute__((target("sse4.2")))
+static void evalX8Sse42(const StdDeck_CardMask *cards, int n_cards, HandVal *out) {
+	evalX8Kernel(cards, n_cards, out);
+}
+
+__attribute__((target("avx2")))
+static void evalX8Avx2(const StdDeck_CardMask *cards, int n_cards, HandVal *out) {
+	evalX8Kernel(cards, n_cards, out);
+}
+#endif
+
+static struct {
+	const char *name;
+	EvalX8Fn fn;
+} x8_paths[] = {
+#if defined(__x86_64__) || defined(__i386__)
+	{ "avx2", evalX8Avx2 },
+	{ "sse4.2", evalX8Sse42 },
+#endif
+	{ "generic", evalX8Generic },
+	{ "scalar", evalX8Scalar },
+};
+
+#define N_X8_PATHS ((int) (sizeof x8_paths / sizeof x8_paths[0]))
+
+static int x8_path = N_X8_PATHS - 1;
+static int simd_eval = 1;
+static pthread_once_t x8_once = PTHREAD_ONCE_INIT;
+
+static int x8Supported(const char *name) {
+#if defined(__x86_64__) || defined(__i386__)
+	__builtin_cpu_init();
+	if (strcmp(name, "avx2") == 0)
+		return __builtin_cpu_supports("avx2");
+	if (strcmp(name, "sse4.2") == 0)
+		return __builtin_cpu_supports("sse4.2");
+#endif
+	return 1;
+}
+
+/* Compares a path against the scalar evaluator on random hands of every
+ * size the enumerations use */
+static int x8Check(EvalX8Fn fn) {
+	StdDeck_CardMask cards[EVAL_X8];
+	HandVal got[EVAL_X8];
+	PokerRand rand;
+	int i, j, n;
+
+	pokerRandSeed(&rand, 0);
+	for (i = 0; i < 20000; i++) {
+		n = 1 + i % EVALTAB_MAX_CARDS;
+		for (j = 0; j < EVAL_X8; j++) {
+			StdDeck_CardMask_RESET(cards[j]);
+			while (StdDeck_numCards(cards[j]) < n)
+				StdDeck_CardMask_SET(cards[j], pokerRandBelow(&rand, StdDeck_N_CARDS));
+		}
+		fn(cards, n, got);
+		for (j = 0; j < EVAL_X8; j++)
+			if (got[j] != StdDeck_StdRules_EVAL_N(cards[j], n))
+				return 0;
+	}
+	return 1;
+}
+
+static void x8Select(void) {
+	int i;
+
+	for (i = 0; i < StdDeck_Suit_COUNT; i++)
+		x8_suit_shift[i] = __builtin_ctzll(StdDeck_MASK(StdDeck_MAKE_CARD(0, i)).cards_n);
+
+	for (i = 0; i < N_X8_PATHS - 1; i++)
+		if (x8Supported(x8_paths[i].name) && x8Check(x8_paths[i].fn))
+			break;
+	x8_path = i;
+}
+
+/* StdDeck_StdRules_EVAL_N for each of EVAL_X8 hands of n_cards cards */
+void evalX8(const StdDeck_CardMask *cards, int n_cards, HandVal *out) {
+	pthread_once(&x8_once, x8Select);
+	if (!simd_eval || n_cards > EVALTAB_MAX_CARDS)
+		x8_paths[N_X8_PATHS - 1].fn(cards, n_cards, out);
+	else
+		x8_paths[x8_path].fn(cards, n_cards, out);
+}
+
+/* StdDeck_StdRules_EVAL_TYPE for each of EVAL_X8 hands */
+void evalTypeX8(const StdDeck_CardMask *cards, int n_cards, int *out) {
+	HandVal vals[EVAL_X8];
+	int i;
+
+	evalX8(cards, n_cards, vals);
+	for (i = 0; i < EVAL_X8; i++)
+		out[i] = HandVal_HANDTYPE(vals[i]);
+}
+
+void setSimdEval(int on) {
+	simd_eval = on;
+}
+
+int getSimdEval(void) {
+	return simd_eval;
+}
+
+/* The name of the path evalX8 uses: "avx2", "sse4.2", "generic" or
+ * "scalar" */
+const char *simdEvalPath(void) {
+	pthread_once(&x8_once, x8Select);
+	return x8_paths[simd_eval ? x8_path : N_X8_PATHS - 1].name;
+}
+
+/*
+ * Evaluates count hands of n_cards cards each, through the lookup table if
+ * t is not NULL, otherwise EVAL_X8 at a time on the SIMD path and the rest
+ * one by one with the evaluator for n_cards.
+ */
+void evalBlock(const EvalTable *t, const StdDeck_CardMask *cards, int n_cards, HandVal *out, int count) {
+	EvalNFn eval = evalNSized(n_cards);
+	int i = 0;
+
+	if (t == NULL && simd_eval && n_cards <= EVALTAB_MAX_CARDS) {
+		pthread_once(&x8_once, x8Select);
+		for (; i + EVAL_X8 <= count; i += EVAL_X8)
+			x8_paths[x8_path].fn(cards + i, n_cards, out + i);
+	}
+	for (; i < count; i++)
+		out[i] = evalTableSized(t, eval, cards[i], n_cards);
+}
@@ -0,0 +1,483 @@
+#include "poker-eval/poker_defs.h"
+#include "poker-eval-api.h"
+#include <fcntl.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+/*
+ * Results cache for handStrength and handPotential.  A spot's result only
+ * depends on its cards up to relabelling the suits, so spots are keyed by
+ * the least image of (pocket, board) under the 24 suit permutations, packed
+ * as sorted card indices with the kind of result on top.
+ *
+ * There are two tiers with the same layout: one in the process, and
+ * optionally one in a file mapped shared, so that forked workers (or any
+ * processes opening the same file) see each other's results.  Both are
+ * SPOT_WAYS-way set associative tables that evict at random once a set is
+ * full.  Nothing is locked: entries are written and read a word at a time,
+ * and each carries the XOR of its other words, so a reader that races a
+ * writer sees a mismatch and takes it as a miss.
+ *
+ * The tiers are set up and torn down by spotCacheSetSize, spotCacheOpen and
+ * spotCacheClose, which must not run while other threads use the cache.
+ */
+
+#define SPOT_MAGIC "PESPOT01"
+#define SPOT_WAYS 4
+
+typedef struct {
+	uint64 key;
+	uint64 v0;
+	uint64 v1;
+	uint64 check;
+} SpotEntry;
+
+typedef struct {
+	char magic[8];
+	uint64 nsets;
+	uint64 reserved[2];
+} SpotFileHeader;
+
+typedef struct {
+	SpotEntry *entries;
+	uint64 nsets;
+	/* the whole mapping, for the shared tier */
+	void *map;
+	size_t mapsize;
+} SpotTier;
+
+static SpotTier local_tier = { NULL, 0, NULL, 0 };
+static SpotTier shared_tier = { NULL, 0, NULL, 0 };
+static uint64 spot_hits, spot_shared_hits, spot_misses, spot_inserts, spot_evictions;
+static uint64 spot_victim;
+
+static uint8 spot_perms[24][4];
+static int spot_nperms = 0;
+
+#define SPOT_LOAD(p) __atomic_load_n((p), __ATOMIC_RELAXED)
+#define SPOT_STORE(p, v) __atomic_store_n((p), (v), __ATOMIC_RELAXED)
+#define SPOT_COUNT(p) __atomic_fetch_add((p), 1, __ATOMIC_RELAXED)
+
+static void spotPermsInit(void) {
+	int s0, s1, s2, s3, n = 0;
+
+	for (s0 = 0; s0 < 4; s0++)
+	for (s1 = 0; s1 < 4; s1++)
+	for (s2 = 0; s2 < 4; s2++)
+	for (s3 = 0; s3 < 4; s3++) {
+		if (s0 == s1 || s0 == s2 || s0 == s3 || s1 == s2 || s1 == s3 || s2 == s3)
+			continue;
+		spot_perms[n][0] = s0; spot_perms[n][1] = s1; spot_perms[n][2] = s2; spot_perms[n][3] = s3;
+		n++;
+	}
+	spot_nperms = n;
+}
+
+/* The image of m with suit s moved to suit perm[s] */
+static uint64 spotPermute(uint64 m, const uint8 *perm) {
+	uint64 out = 0;
+	int s;
+
+	for (s = 0; s < 4; s++)
+		out |= ((m >> (16 * s)) & 0x1fff) << (16 * perm[s]);
+	return out;
+}
+
+/* Appends the card indices of m, lowest first, 6 bits each */
+static uint64 spotPack(uint64 key, uint64 m, int *shift) {
+	int s, r;
+
+	for (s = 0; s < 4; s++) {
+		for (r = 0; r < StdDeck_Rank_COUNT; r++) {
+			if (m & ((uint64) 1 << (16 * s + r))) {
+				key |= (uint64) (StdDeck_MAKE_CARD(r, s) + 1) << *shift;
+				*shift += 6;
+			}
+		}
+	}
+	return key;
+}
+
+static int spotCacheActive(void) {
+	return local_tier.entries != NULL || shared_tier.entries != NULL;
+}
+
+/*
+ * The cache key of a result of the given kind for pocket and board, or 0
+ * if the cache is off or the spot has too many cards to key.
+ */
+uint64 spotKey(StdDeck_CardMask pocket, StdDeck_CardMask board, int kind) {
+	uint64 p = pocket.cards_n, b = board.cards_n, bestp = p, bestb = b, ip, ib, key;
+	int k, shift = 0;
+
+	if (!spotCacheActive() || StdDeck_numCards(pocket) > 2 || StdDeck_numCards(board) > 5)
+		return 0;
+	for (k = 0; k < spot_nperms; k++) {
+		ip = spotPermute(p, spot_perms[k]);
+		ib = spotPermute(b, spot_perms[k]);
+		if (ip < bestp || (ip == bestp && ib < bestb)) {
+			bestp = ip;
+			bestb = ib;
+		}
+	}
+	key = spotPack(0, bestp, &shift);
+	shift = 12;
+	key = spotPack(key, bestb, &shift);
+	return key | (uint64) kind << 60;
+}
+
+/*
+ * Whether (pocket, board) is the least image of its spot under the suit
+ * permutations, the one spotKey packs, so that enumerating only those
+ * visits every spot once.
+ */
+int spotCanonical(StdDeck_CardMask pocket, StdDeck_CardMask board) {
+	uint64 p = pocket.cards_n, b = board.cards_n, ip, ib;
+	int k;
+
+	if (spot_nperms == 0)
+		spotPermsInit();
+	for (k = 0; k < spot_nperms; k++) {
+		ip = spotPermute(p, spot_perms[k]);
+		ib = spotPermute(b, spot_perms[k]);
+		if (ip < p || (ip == p && ib < b))
+			return 0;
+	}
+	return 1;
+}
+
+/* splitmix64's finalizer, to spread the packed cards over the sets */
+static uint64 spotHash(uint64 key) {
+	key = (key ^ (key >> 30)) * 0xBF58476D1CE4E5B9ULL;
+	key = (key ^ (key >> 27)) * 0x94D049BB133111EBULL;
+	return key ^ (key >> 31);
+}
+
+static int spotTierGet(const SpotTier *t, uint64 key, uint64 *v0, uint64 *v1) {
+	SpotEntry *e;
+	uint64 k, a, b;
+	int w;
+
+	if (t->entries == NULL)
+		return 0;
+	e = &t->entries[(spotHash(key) & (t->nsets - 1)) * SPOT_WAYS];
+	for (w = 0; w < SPOT_WAYS; w++, e++) {
+		k = SPOT_LOAD(&e->key);
+		if (k != key)
+			continue;
+		a = SPOT_LOAD(&e->v0);
+		b = SPOT_LOAD(&e->v1);
+		if ((k ^ a ^ b) != SPOT_LOAD(&e->check))
+			continue;
+		*v0 = a;
+		*v1 = b;
+		return 1;
+	}
+	return 0;
+}
+
+static void spotTierPut(SpotTier *t, uint64 key, uint64 v0, uint64 v1) {
+	SpotEntry *set, *e = NULL;
+	uint64 k;
+	int w;
+
+	if (t->entries == NULL)
+		return;
+	set = &t->entries[(spotHash(key) & (t->nsets - 1)) * SPOT_WAYS];
+	for (w = 0; w < SPOT_WAYS; w++) {
+		k = SPOT_LOAD(&set[w].key);
+		if (k == key || k == 0) {
+			e = &set[w];
+			break;
+		}
+	}
+	if (e == NULL) {
+		e = &set[SPOT_COUNT(&spot_victim) % SPOT_WAYS];
+		SPOT_COUNT(&spot_evictions);
+	}
+	SPOT_STORE(&e->key, key);
+	SPOT_STORE(&e->v0, v0);
+	SPOT_STORE(&e->v1, v1);
+	SPOT_STORE(&e->check, key ^ v0 ^ v1);
+}
+
+/* Whether key is cached, without counting a hit or miss */
+static int spotCacheHas(uint64 key) {
+	uint64 a, b;
+
+	return key != 0 && (spotTierGet(&local_tier, key, &a, &b) || spotTierGet(&shared_tier, key, &a, &b));
+}
+
+/* Looks key up, in the process then in the shared tier.  Returns 1 and
+ * the two values stored with it on a hit. */
+int spotCacheGet(uint64 key, double *v0, double *v1) {
+	uint64 a, b;
+
+	if (key == 0)
+		return 0;
+	if (spotTierGet(&local_tier, key, &a, &b)) {
+		SPOT_COUNT(&spot_hits);
+	}
+	else if (spotTierGet(&shared_tier, key, &a, &b)) {
+		SPOT_COUNT(&spot_shared_hits);
+		spotTierPut(&local_tier, key, a, b);
+	}
+	else {
+		SPOT_COUNT(&spot_misses);
+		return 0;
+	}
+	memcpy(v0, &a, sizeof a);
+	memcpy(v1, &b, sizeof b);
+	return 1;
+}
+
+void spotCachePut(uint64 key, double v0, double v1) {
+	uint64 a, b;
+
+	if (key == 0)
+		return;
+	memcpy(&a, &v0, sizeof a);
+	memcpy(&b, &v1, sizeof b);
+	SPOT_COUNT(&spot_inserts);
+	spotTierPut(&local_tier, key, a, b);
+	spotTierPut(&shared_tier, key, a, b);
+}
+
+/* The number of sets for at least entries entries, a power of two */
+static uint64 spotSets(long entries) {
+	uint64 n = 1;
+
+	while (n * SPOT_WAYS < (uint64) entries)
+		n <<= 1;
+	return n;
+}
+
+/*
+ * Sizes the process tier to hold at least entries results, dropping what it
+ * held, or frees it if entries is 0.  Returns 1 on success.
+ */
+int spotCacheSetSize(long entries) {
+	SpotEntry *e = NULL;
+	uint64 nsets = 0;
+
+	if (spot_nperms == 0)
+		spotPermsInit();
+	if (entries > 0) {
+		nsets = spotSets(entries);
+		e = calloc(nsets * SPOT_WAYS, sizeof *e);
+		if (e == NULL)
+			return 0;
+	}
+	free(local_tier.entries);
+	local_tier.entries = e;
+	local_tier.nsets = nsets;
+	return 1;
+}
+
+long spotCacheSize(void) {
+	return local_tier.nsets * SPOT_WAYS;
+}
+
+/*
+ * Maps the shared tier from path, creating the file to hold at least
+ * entries results if it doesn't exist.  An existing file keeps its size.
+ * Returns 1 on success, or 0 if the file can't be created or mapped or
+ * isn't a spot cache.
+ */
+int spotCacheOpen(const char *path, long entries) {
+	SpotFileHeader h;
+	struct stat st;
+	size_t size;
+	void *map;
+	int fd;
+
+	fd = open(path, O_RDWR | O_CREAT, 0644);
+	if (fd < 0)
+		return 0;
+	if (fstat(fd, &st) != 0) {
+		close(fd);
+		return 0;
+	}
+	if (st.st_size == 0) {
+		memset(&h, 0, sizeof h);
+		memcpy(h.magic, SPOT_MAGIC, sizeof h.magic);
+		h.nsets = spotSets(entries > 0 ? entries : 1);
+		size = sizeof h + h.nsets * SPOT_WAYS * sizeof(SpotEntry);
+		if (ftruncate(fd, size) != 0 || pwrite(fd, &h, sizeof h, 0) != sizeof h) {
+			close(fd);
+			return 0;
+		}
+	}
+	else
+		size = st.st_size;
+	map = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+	close(fd);
+	if (map == MAP_FAILED)
+		return 0;
+
+	memcpy(&h, map, sizeof h);
+	if (size < sizeof h || memcmp(h.magic, SPOT_MAGIC, sizeof h.magic) != 0 || h.nsets == 0
+			|| (h.nsets & (h.nsets - 1)) != 0
+			|| size != sizeof h + h.nsets * SPOT_WAYS * sizeof(SpotEntry)) {
+		munmap(map, size);
+		return 0;
+	}
+	spotCacheClose();
+	if (spot_nperms == 0)
+		spotPermsInit();
+	shared_tier.map = map;
+	shared_tier.mapsize = size;
+	shared_tier.entries = (SpotEntry *) ((char *) map + sizeof h);
+	shared_tier.nsets = h.nsets;
+	return 1;
+}
+
+/* Unmaps the shared tier; the file keeps its results */
+void spotCacheClose(void) {
+	if (shared_tier.map != NULL)
+		munmap(shared_tier.map, shared_tier.mapsize);
+	memset(&shared_tier, 0, sizeof shared_tier);
+}
+
+/* Empties both tiers */
+void spotCacheClear(void) {
+	if (local_tier.entries != NULL)
+		memset(local_tier.entries, 0, local_tier.nsets * SPOT_WAYS * sizeof(SpotEntry));
+	if (shared_tier.entries != NULL)
+		memset(shared_tier.entries, 0, shared_tier.nsets * SPOT_WAYS * sizeof(SpotEntry));
+}
+
+static long spotTierUsed(const SpotTier *t) {
+	long n = 0;
+	uint64 i;
+
+	for (i = 0; i < t->nsets * SPOT_WAYS; i++)
+		n += SPOT_LOAD(&t->entries[i].key) != 0;
+	return n;
+}
+
+/* The counters since the last reset, and how full the tiers are */
+SpotCacheStats spotCacheStats(void) {
+	SpotCacheStats s;
+
+	s.hits = SPOT_LOAD(&spot_hits);
+	s.shared_hits = SPOT_LOAD(&spot_shared_hits);
+	s.misses = SPOT_LOAD(&spot_misses);
+	s.inserts = SPOT_LOAD(&spot_inserts);
+	s.evictions = SPOT_LOAD(&spot_evictions);
+	s.size = local_tier.nsets * SPOT_WAYS;
+	s.used = spotTierUsed(&local_tier);
+	s.shared_size = shared_tier.nsets * SPOT_WAYS;
+	s.shared_used = spotTierUsed(&shared_tier);
+	return s;
+}
+
+void spotCacheResetStats(void) {
+	SPOT_STORE(&spot_hits, 0);
+	SPOT_STORE(&spot_shared_hits, 0);
+	SPOT_STORE(&spot_misses, 0);
+	SPOT_STORE(&spot_inserts, 0);
+	SPOT_STORE(&spot_evictions, 0);
+}
+
+/*
+ * Prewarming.  Every flop is the image of one whose suits are in canonical
+ * order, so with every pocket it is enough to run through those 1755 flops;
+ * for one pocket, all the flops it leaves are run through and the keys
+ * merge the isomorphic ones.  Spots already cached are skipped.
+ */
+typedef struct {
+	StdDeck_CardMask pocket;
+	int allpockets;
+	int kinds;
+	StdDeck_CardMask *flops;
+	long *computed;
+} SpotPrewarm;
+
+static void spotPrewarmSpot(SpotPrewarm *job, StdDeck_CardMask pocket, StdDeck_CardMask flop, long *computed) {
+	if ((job->kinds & (1 << SPOT_HS)) && !spotCacheHas(spotKey(pocket, flop, SPOT_HS))) {
+		handStrength(pocket, flop);
+		(*computed)++;
+	}
+	if ((job->kinds & (1 << SPOT_HP)) && !spotCacheHas(spotKey(pocket, flop, SPOT_HP))) {
+		handPotentialMask(pocket, flop, 6);
+		(*computed)++;
+	}
+}
+
+static void spotPrewarmFlop(void *arg, int item) {
+	SpotPrewarm *job = arg;
+	StdDeck_CardMask flop = job->flops[item], pocket;
+	int i1, i2;
+
+	if (!job->allpockets) {
+		spotPrewarmSpot(job, job->pocket, flop, &job->computed[item]);
+		return;
+	}
+	for (i1 = 0; i1 < StdDeck_N_CARDS; i1++) {
+		if (StdDeck_CardMask_CARD_IS_SET(flop, i1))
+			continue;
+		for (i2 = 0; i2 < i1; i2++) {
+			if (StdDeck_CardMask_CARD_IS_SET(flop, i2))
+				continue;
+			StdDeck_CardMask_OR(pocket, StdDeck_MASK(i1), StdDeck_MASK(i2));
+			spotPrewarmSpot(job, pocket, flop, &job->computed[item]);
+		}
+	}
+}
+
+/* Whether no suit permutation gives a smaller flop mask */
+static int spotFlopCanonical(StdDeck_CardMask flop) {
+	int k;
+
+	for (k = 0; k < spot_nperms; k++)
+		if (spotPermute(flop.cards_n, spot_perms[k]) < flop.cards_n)
+			return 0;
+	return 1;
+}
+
+/*
+ * Computes and caches the results in kinds (bits 1 << SPOT_HS, 1 << SPOT_HP)
+ * for pocket on every flop, or for every pocket if pocket is empty.
+ * Returns the number of results computed, or -1 if the cache is off.
+ */
+long spotCachePrewarm(StdDeck_CardMask pocket, int kinds) {
+	SpotPrewarm job;
+	StdDeck_CardMask flop;
+	int i1, i2, i3, nflops = 0, i;
+	long total = 0;
+
+	if (!spotCacheActive())
+		return -1;
+	job.pocket = pocket;
+	job.allpockets = StdDeck_numCards(pocket) == 0;
+	job.kinds = kinds;
+	job.flops = malloc(22100 * sizeof *job.flops);
+	job.computed = calloc(22100, sizeof *job.computed);
+	if (job.flops == NULL || job.computed == NULL) {
+		free(job.flops);
+		free(job.computed);
+		return -1;
+	}
+	for (i1 = 2; i1 < StdDeck_N_CARDS; i1++) {
+		for (i2 = 1; i2 < i1; i2++) {
+			for (i3 = 0; i3 < i2; i3++) {
+				StdDeck_CardMask_OR(flop, StdDeck_MASK(i1), StdDeck_MASK(i2));
+				StdDeck_CardMask_OR(flop, flop, StdDeck_MASK(i3));
+				if (job.allpockets ? !spotFlopCanonical(flop) : StdDeck_CardMask_ANY_SET(flop, pocket))
+					continue;
+				job.flops[nflops++] = flop;
+			}
+		}
+	}
+
+	poolRun(spotPrewarmFlop, &job, nflops);
+	for (i = 0; i < nflops; i++)
+		total += job.computed[i];
+	free(job.flops);
+	free(job.computed);
+	return total;
+}
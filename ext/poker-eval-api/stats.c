@@ -0,0 +1,155 @@
+#include "poker-eval/poker_defs.h"
+#include "poker-eval-api.h"
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#endif
+
+/*
+ * Instrumentation counters.  Each thread that counts gets its own block of
+ * counters, so the hot paths never share a cache line or take a lock; the
+ * blocks are kept on a list and evalStatsRead sums them.  When a thread
+ * exits its counts are added to those of the threads gone before, and its
+ * block is freed, so nothing counted is lost and nothing builds up with
+ * threads coming and going.  Resetting takes a snapshot of the sums that
+ * later reads subtract, rather than writing to other threads' blocks under
+ * them.
+ *
+ * Without POKEREVAL_STATS the hooks in the evaluators compile to nothing,
+ * and only evalStatsRead and evalStatsReset are left, doing nothing.
+ */
+
+#ifdef POKEREVAL_STATS
+
+typedef struct EvalStatBlock {
+	EvalStatCounters c[EVAL_STAT_ENTRIES];
+	struct EvalStatBlock *next;
+} EvalStatBlock;
+
+#define STAT_FIELDS (sizeof(EvalStatCounters) / sizeof(uint64))
+
+static __thread EvalStatBlock *stat_block = NULL;
+static EvalStatBlock *stat_blocks = NULL;
+static EvalStatCounters stat_baseline[EVAL_STAT_ENTRIES];
+static pthread_mutex_t stat_lock = PTHREAD_MUTEX_INITIALIZER;
+/* a block for a thread that can't allocate one, shared and so racy */
+static EvalStatBlock stat_fallback;
+/* the counts of the threads that have exited */
+static EvalStatBlock stat_retired;
+static pthread_key_t stat_key;
+static pthread_once_t stat_key_once = PTHREAD_ONCE_INIT;
+static int stat_key_ok = 0;
+
+/* Run as the thread exits: folds its block into stat_retired and frees it */
+static void evalStatsRetire(void *arg) {
+	EvalStatBlock *b = arg, **link;
+	uint64 *r = (uint64 *) stat_retired.c;
+	const uint64 *c = (const uint64 *) b->c;
+	int i;
+
+	pthread_mutex_lock(&stat_lock);
+	for (i = 0; i < EVAL_STAT_ENTRIES * (int) STAT_FIELDS; i++)
+		r[i] += c[i];
+	for (link = &stat_blocks; *link != b; link = &(*link)->next)
+		;
+	*link = b->next;
+	pthread_mutex_unlock(&stat_lock);
+	stat_block = NULL;
+	free(b);
+}
+
+static void evalStatsKeyInit(void) {
+	stat_key_ok = pthread_key_create(&stat_key, evalStatsRetire) == 0;
+}
+
+EvalStatCounters *evalStatsThread(void) {
+	EvalStatBlock *b = stat_block;
+
+	if (b == NULL) {
+		pthread_once(&stat_key_once, evalStatsKeyInit);
+		b = calloc(1, sizeof *b);
+		if (b == NULL)
+			return stat_fallback.c;
+		pthread_mutex_lock(&stat_lock);
+		b->next = stat_blocks;
+		stat_blocks = b;
+		pthread_mutex_unlock(&stat_lock);
+		/* without the key the block is simply kept */
+		if (stat_key_ok)
+			pthread_setspecific(stat_key, b);
+		stat_block = b;
+	}
+	return b->c;
+}
+
+uint64 evalStatsNs(void) {
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64) ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+uint64 evalStatsCycles(void) {
+#if defined(__x86_64__) || defined(__i386__)
+	return __rdtsc();
+#else
+	return 0;
+#endif
+}
+
+/* Called with stat_lock held */
+static void evalStatsSum(EvalStatCounters *out) {
+	const EvalStatBlock *b;
+	uint64 *o = (uint64 *) out;
+	const uint64 *c;
+	int i;
+
+	memcpy(out, stat_retired.c, EVAL_STAT_ENTRIES * sizeof *out);
+	for (b = stat_blocks; ; b = b->next) {
+		if (b == NULL)
+			b = &stat_fallback;
+		c = (const uint64 *) b->c;
+		for (i = 0; i < EVAL_STAT_ENTRIES * (int) STAT_FIELDS; i++)
+			o[i] += __atomic_load_n(&c[i], __ATOMIC_RELAXED);
+		if (b == &stat_fallback)
+			break;
+	}
+}
+
+/*
+ * Fills out[EVAL_STAT_ENTRIES] with the counts of every thread since the
+ * last reset.  Returns 1, or 0 if the extension was built without them.
+ */
+int evalStatsRead(EvalStatCounters *out) {
+	uint64 *o = (uint64 *) out;
+	const uint64 *base = (const uint64 *) stat_baseline;
+	int i;
+
+	pthread_mutex_lock(&stat_lock);
+	evalStatsSum(out);
+	for (i = 0; i < EVAL_STAT_ENTRIES * (int) STAT_FIELDS; i++)
+		o[i] -= base[i];
+	pthread_mutex_unlock(&stat_lock);
+	return 1;
+}
+
+void evalStatsReset(void) {
+	pthread_mutex_lock(&stat_lock);
+	evalStatsSum(stat_baseline);
+	pthread_mutex_unlock(&stat_lock);
+}
+
+#else
+
+int evalStatsRead(EvalStatCounters *out) {
+	memset(out, 0, EVAL_STAT_ENTRIES * sizeof *out);
+	return 0;
+}
+
+void evalStatsReset(void) {
+}
+
+#endif
@@ -0,0 +1,155 @@
+#include "poker-eval/poker_defs.h"
+#include "poker-eval-api.h"
+
+/*
+ * Suit isomorphism.  Relabelling suits does not change any hand's value, so
+ * when some permutations of the suits leave our cards and the board alone,
+ * opponent hands and runouts that are images of each other under those
+ * permutations give identical outcomes.  Enumerators can then evaluate one
+ * representative per orbit and weight it by the orbit's size.
+ *
+ * The permutations that fix a set of cards are exactly those that only
+ * exchange suits holding the same ranks, so the group is described by
+ * classes of interchangeable suits.  For one or two cards that is enough to
+ * pick the representative directly: within each class, the cards (highest
+ * rank first) must use the lowest suits of the class, in order.  Longer
+ * card lists fall back to comparing every image.
+ */
+
+static int suit_isomorphism = 1;
+
+void setSuitIsomorphism(int on) {
+	suit_isomorphism = on;
+}
+
+int getSuitIsomorphism(void) {
+	return suit_isomorphism;
+}
+
+static uint32 suitRanks(StdDeck_CardMask m, int suit) {
+	switch (suit) {
+	case StdDeck_Suit_HEARTS:
+		return StdDeck_CardMask_HEARTS(m);
+	case StdDeck_Suit_DIAMONDS:
+		return StdDeck_CardMask_DIAMONDS(m);
+	case StdDeck_Suit_CLUBS:
+		return StdDeck_CardMask_CLUBS(m);
+	default:
+		return StdDeck_CardMask_SPADES(m);
+	}
+}
+
+/* Builds the group that permutes suits with equal keys among themselves */
+static void suitGroupBuild(SuitGroup *g, const uint64 *key) {
+	int s, t, c, k;
+	int s0, s1, s2, s3;
+	uint8 *p;
+
+	for (s = 0; s < 4; s++) {
+		g->suitclass[s] = s;
+		g->pos[s] = 0;
+		g->classsize[s] = 1;
+		if (!suit_isomorphism)
+			continue;
+		for (t = 0; t < s; t++) {
+			if (key[t] == key[s]) {
+				g->suitclass[s] = g->suitclass[t];
+				g->pos[s]++;
+			}
+		}
+		for (t = 0; t < 4; t++)
+			if (t != s && key[t] == key[s])
+				g->classsize[s]++;
+	}
+
+	g->n = 0;
+	for (s0 = 0; s0 < 4; s0++)
+	for (s1 = 0; s1 < 4; s1++)
+	for (s2 = 0; s2 < 4; s2++)
+	for (s3 = 0; s3 < 4; s3++) {
+		if (s0 == s1 || s0 == s2 || s0 == s3 || s1 == s2 || s1 == s3 || s2 == s3)
+			continue;
+		if (g->suitclass[s0] != g->suitclass[0] || g->suitclass[s1] != g->suitclass[1]
+				|| g->suitclass[s2] != g->suitclass[2] || g->suitclass[s3] != g->suitclass[3])
+			continue;
+		p = g->perm[g->n];
+		p[0] = s0; p[1] = s1; p[2] = s2; p[3] = s3;
+		g->n++;
+	}
+
+	if (g->n > 1) {
+		for (k = 0; k < g->n; k++)
+			for (c = 0; c < StdDeck_N_CARDS; c++)
+				g->cardimg[k][c] = StdDeck_MAKE_CARD(StdDeck_RANK(c), g->perm[k][StdDeck_SUIT(c)]);
+	}
+}
+
+/* The permutations that map both a and b onto themselves.  With
+ * isomorphism switched off this is just the identity. */
+void suitGroupFixing(SuitGroup *g, StdDeck_CardMask a, StdDeck_CardMask b) {
+	uint64 key[4];
+	int s;
+
+	for (s = 0; s < 4; s++)
+		key[s] = ((uint64) suitRanks(a, s) << 16) | suitRanks(b, s);
+	suitGroupBuild(g, key);
+}
+
+/* The subgroup of g that maps the given cards onto themselves */
+void suitSubgroupFixing(SuitGroup *h, const SuitGroup *g, const int *cards, int n) {
+	StdDeck_CardMask m;
+	uint64 key[4];
+	int s, i;
+
+	StdDeck_CardMask_RESET(m);
+	for (i = 0; i < n; i++)
+		StdDeck_CardMask_OR(m, m, StdDeck_MASK(cards[i]));
+	for (s = 0; s < 4; s++)
+		key[s] = ((uint64) g->suitclass[s] << 16) | suitRanks(m, s);
+	suitGroupBuild(h, key);
+}
+
+/* Image of a descending list of card indices under g's k'th permutation,
+ * sorted descending again */
+static void suitPermuteCards(const SuitGroup *g, int k, const int *cards, int n, int *out) {
+	int i, j, c;
+
+	for (i = 0; i < n; i++) {
+		c = g->cardimg[k][cards[i]];
+		for (j = i; j > 0 && out[j - 1] < c; j--)
+			out[j] = out[j - 1];
+		out[j] = c;
+	}
+}
+
+/*
+ * cards is a descending list of n card indices.  Returns 0 if it is not
+ * the representative of its orbit under g, otherwise the size of the orbit.
+ */
+int suitOrbitWeight(const SuitGroup *g, const int *cards, int n) {
+	int img[StdDeck_N_CARDS];
+	int k, i, fixed = 0;
+
+	if (g->n == 1)
+		return 1;
+
+	if (n == 1) {
+		int s = StdDeck_SUIT(cards[0]);
+
+		return g->pos[s] == 0 ? g->classsize[s] : 0;
+	}
+
+	if (n == 2)
+		return suitOrbitWeight2(g, cards[0], cards[1]);
+
+	for (k = 0; k < g->n; k++) {
+		suitPermuteCards(g, k, cards, n, img);
+		for (i = 0; i < n && img[i] == cards[i]; i++)
+			;
+		if (i == n)
+			fixed++;
+		else if (img[i] < cards[i])
+			return 0;
+	}
+	return g->n / fixed;
+}
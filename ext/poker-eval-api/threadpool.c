@@ -0,0 +1,165 @@
+#include "poker-eval/poker_defs.h"
+#include "poker-eval-api.h"
+#include <pthread.h>
+#include <stdint.h>
+#include <stdlib.h>
+
+/*
+ * A small worker pool for splitting an enumeration's outer loop.
+ *
+ * Work is submitted as a batch of nitems independent items.  Idle workers
+ * take items from the oldest batch that still has some left, and the
+ * submitting thread takes items from its own batch too, so a batch always
+ * finishes even when there are no workers (threads == 1, or in a forked
+ * child whose workers did not survive the fork).
+ */
+
+#define POOL_MAX_THREADS 256
+
+static pthread_mutex_t pool_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t pool_work = PTHREAD_COND_INITIALIZER;
+static pthread_cond_t pool_finished = PTHREAD_COND_INITIALIZER;
+static PoolBatch *pool_queue = NULL;
+static pthread_t pool_workers[POOL_MAX_THREADS];
+static int pool_nworkers = 0;
+static int pool_threads = 1;
+/* bumped to stop the workers started before it */
+static int pool_generation = 0;
+static int pool_atfork_registered = 0;
+
+/* Called with pool_lock held.  Returns the batch the item belongs to, or
+ * NULL if there is nothing queued. */
+static PoolBatch *poolTakeItem(PoolBatch *only, int *item) {
+	PoolBatch **link = &pool_queue;
+	PoolBatch *b;
+
+	while ((b = *link) != NULL) {
+		if (only == NULL || b == only) {
+			*item = b->next++;
+			if (b->next >= b->nitems)
+				*link = b->link;
+			return b;
+		}
+		link = &b->link;
+	}
+	return NULL;
+}
+
+/* Called with pool_lock held */
+static void poolFinishItem(PoolBatch *b) {
+	b->done += 1;
+	if (b->done >= b->nitems)
+		pthread_cond_broadcast(&pool_finished);
+}
+
+static void *poolWorker(void *arg) {
+	int generation = (int) (intptr_t) arg;
+	PoolBatch *b;
+	int item;
+
+	pthread_mutex_lock(&pool_lock);
+	for (;;) {
+		while (generation == pool_generation && pool_queue == NULL)
+			pthread_cond_wait(&pool_work, &pool_lock);
+		if (generation != pool_generation)
+			break;
+		b = poolTakeItem(NULL, &item);
+		pthread_mutex_unlock(&pool_lock);
+		b->fn(b->arg, item);
+		pthread_mutex_lock(&pool_lock);
+		poolFinishItem(b);
+	}
+	pthread_mutex_unlock(&pool_lock);
+	return NULL;
+}
+
+/* Called with pool_lock held, which is dropped while joining.  The workers
+ * are taken off the pool before that, so that no other caller joins them
+ * too, and any started meanwhile belong to the next generation. */
+static void poolStopWorkers(void) {
+	pthread_t stopped[POOL_MAX_THREADS];
+	int i, n = pool_nworkers;
+
+	for (i = 0; i < n; i++)
+		stopped[i] = pool_workers[i];
+	pool_nworkers = 0;
+	pool_generation++;
+	pthread_cond_broadcast(&pool_work);
+	pthread_mutex_unlock(&pool_lock);
+	for (i = 0; i < n; i++)
+		pthread_join(stopped[i], NULL);
+	pthread_mutex_lock(&pool_lock);
+}
+
+/* Called with pool_lock held */
+static void poolStartWorkers(void) {
+	while (pool_nworkers < pool_threads - 1) {
+		if (pthread_create(&pool_workers[pool_nworkers], NULL, poolWorker, (void *) (intptr_t) pool_generation) != 0)
+			break;
+		pool_nworkers++;
+	}
+}
+
+/* The workers do not exist in a forked child; forget about them there and
+ * start new ones on the next run. */
+static void poolAtforkChild(void) {
+	pthread_mutex_init(&pool_lock, NULL);
+	pthread_cond_init(&pool_work, NULL);
+	pthread_cond_init(&pool_finished, NULL);
+	pool_queue = NULL;
+	pool_nworkers = 0;
+}
+
+void setThreadCount(int n) {
+	if (n < 1)
+		n = 1;
+	if (n > POOL_MAX_THREADS)
+		n = POOL_MAX_THREADS;
+
+	pthread_mutex_lock(&pool_lock);
+	if (!pool_atfork_registered) {
+		pthread_atfork(NULL, NULL, poolAtforkChild);
+		pool_atfork_registered = 1;
+	}
+	pool_threads = n;
+	if (pool_nworkers > pool_threads - 1)
+		poolStopWorkers();
+	pthread_mutex_unlock(&pool_lock);
+}
+
+int getThreadCount(void) {
+	return pool_threads;
+}
+
+void poolRun(PoolFn fn, void *arg, int nitems) {
+	PoolBatch batch;
+	PoolBatch **link;
+	int item;
+
+	if (nitems <= 0)
+		return;
+
+	batch.fn = fn;
+	batch.arg = arg;
+	batch.nitems = nitems;
+	batch.next = 0;
+	batch.done = 0;
+	batch.link = NULL;
+
+	pthread_mutex_lock(&pool_lock);
+	poolStartWorkers();
+	for (link = &pool_queue; *link != NULL; link = &(*link)->link)
+		;
+	*link = &batch;
+	pthread_cond_broadcast(&pool_work);
+
+	while (poolTakeItem(&batch, &item) != NULL) {
+		pthread_mutex_unlock(&pool_lock);
+		fn(arg, item);
+		pthread_mutex_lock(&pool_lock);
+		poolFinishItem(&batch);
+	}
+	while (batch.done < batch.nitems)
+		pthread_cond_wait(&pool_finished, &pool_lock);
+	pthread_mutex_unlock(&pool_lock);
+}
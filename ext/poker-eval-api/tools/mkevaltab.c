@@ -0,0 +1,211 @@
+/*
+ * Writes the lookup table read by evalTableLoad.
+ *
+ *   mkevaltab handval.tab
+ *
+ * Every value in the table comes from StdDeck_StdRules_EVAL_N, so the table
+ * evaluator agrees with it on every hand of up to 7 cards.
+ */
+#include "poker-eval/poker_defs.h"
+#include "poker-eval-api.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define ROWSHIFT 11
+#define MAX_KEYS 100000
+
+/* Rank keys, deuce first.  Every multiset of 7 ranks, none more than 4
+ * times, has a different sum, and so does every multiset of n < 7 ranks
+ * (pad two equal-sum n-sets with the same spare ranks to get two 7-sets). */
+static const uint32 rank_keys[StdDeck_Rank_COUNT] = {
+	0, 1, 5, 22, 98, 453, 2031, 8698, 22854, 83661, 262349, 636345, 1479181
+};
+
+static uint32 suitkey[StdDeck_N_RANKMASKS];
+static HandVal flush[StdDeck_N_RANKMASKS];
+
+static uint32 keys[MAX_KEYS];
+static HandVal vals[MAX_KEYS];
+static int nkeys;
+
+static int counts[StdDeck_Rank_COUNT];
+
+/* A hand with the ranks in counts and no more than two cards of a suit */
+static StdDeck_CardMask unsuitedHand(void) {
+	StdDeck_CardMask cards;
+	int load[StdDeck_Suit_COUNT] = { 0 };
+	int used[StdDeck_Suit_COUNT];
+	int r, i, s, best;
+
+	StdDeck_CardMask_RESET(cards);
+	for (r = 0; r < StdDeck_Rank_COUNT; r++) {
+		memset(used, 0, sizeof used);
+		for (i = 0; i < counts[r]; i++) {
+			best = -1;
+			for (s = 0; s < StdDeck_Suit_COUNT; s++)
+				if (!used[s] && (best < 0 || load[s] < load[best]))
+					best = s;
+			used[best] = 1;
+			load[best]++;
+			StdDeck_CardMask_SET(cards, StdDeck_MAKE_CARD(r, best));
+		}
+	}
+	return cards;
+}
+
+static void addMultisets(int rank, int left, int n, uint32 sum) {
+	int c;
+
+	if (rank == StdDeck_Rank_COUNT) {
+		if (left > 0)
+			return;
+		if (nkeys == MAX_KEYS) {
+			fprintf(stderr, "mkevaltab: too many rank multisets\n");
+			exit(1);
+		}
+		keys[nkeys] = (sum << 3) | n;
+		vals[nkeys] = StdDeck_StdRules_EVAL_N(unsuitedHand(), n);
+		nkeys++;
+		return;
+	}
+	for (c = 0; c <= 4 && c <= left; c++) {
+		counts[rank] = c;
+		addMultisets(rank + 1, left - c, n, sum + c * rank_keys[rank]);
+	}
+	counts[rank] = 0;
+}
+
+static int *rowcount;
+
+/* Fullest rows first */
+static int compareRows(const void *a, const void *b) {
+	return rowcount[*(const int *) b] - rowcount[*(const int *) a];
+}
+
+static int compareKeys(const void *a, const void *b) {
+	uint32 x = *(const uint32 *) a, y = *(const uint32 *) b;
+
+	return (x > y) - (x < y);
+}
+
+int main(int argc, char **argv) {
+	EvalTableHeader h;
+	StdDeck_CardMask cards;
+	uint32 *disp, *sorted, maxkey = 0;
+	int *rowstart, *order, *rowkey;
+	unsigned char *used;
+	HandVal *ranks;
+	uint32 nrows, nranks, width = 1u << ROWSHIFT, m;
+	int i, j, n, r, row, size;
+	FILE *f;
+
+	if (argc != 2) {
+		fprintf(stderr, "usage: mkevaltab <file>\n");
+		return 1;
+	}
+
+	for (m = 0; m < StdDeck_N_RANKMASKS; m++) {
+		suitkey[m] = 0;
+		for (r = 0; r < StdDeck_Rank_COUNT; r++)
+			if (m & (1u << r))
+				suitkey[m] += rank_keys[r];
+		flush[m] = 0;
+		n = 0;
+		for (r = 0; r < StdDeck_Rank_COUNT; r++)
+			n += (m >> r) & 1;
+		if (n >= 5 && n <= EVALTAB_MAX_CARDS) {
+			StdDeck_CardMask_RESET(cards);
+			StdDeck_CardMask_SET_SPADES(cards, m);
+			flush[m] = StdDeck_StdRules_EVAL_N(cards, n);
+		}
+	}
+
+	for (n = 1; n <= EVALTAB_MAX_CARDS; n++)
+		addMultisets(0, n, n, 0);
+
+	sorted = malloc(nkeys * sizeof *sorted);
+	memcpy(sorted, keys, nkeys * sizeof *sorted);
+	qsort(sorted, nkeys, sizeof *sorted, compareKeys);
+	for (i = 1; i < nkeys; i++) {
+		if (sorted[i] == sorted[i - 1]) {
+			fprintf(stderr, "mkevaltab: rank keys collide\n");
+			return 1;
+		}
+	}
+	maxkey = sorted[nkeys - 1];
+	free(sorted);
+
+	/* Place the fullest rows first, each at the lowest displacement where
+	 * none of its keys lands on a slot that is already taken */
+	nrows = (maxkey >> ROWSHIFT) + 1;
+	rowcount = calloc(nrows, sizeof *rowcount);
+	rowstart = calloc(nrows + 1, sizeof *rowstart);
+	rowkey = malloc(nkeys * sizeof *rowkey);
+	order = malloc(nrows * sizeof *order);
+	disp = calloc(nrows, sizeof *disp);
+	for (i = 0; i < nkeys; i++)
+		rowcount[keys[i] >> ROWSHIFT]++;
+	for (row = 0; row < (int) nrows; row++)
+		rowstart[row + 1] = rowstart[row] + rowcount[row];
+	memset(rowcount, 0, nrows * sizeof *rowcount);
+	for (i = 0; i < nkeys; i++) {
+		row = keys[i] >> ROWSHIFT;
+		rowkey[rowstart[row] + rowcount[row]++] = i;
+	}
+	for (row = 0; row < (int) nrows; row++)
+		order[row] = row;
+	qsort(order, nrows, sizeof *order, compareRows);
+
+	size = nkeys + 2 * width;
+	used = calloc(size, 1);
+	nranks = width;
+	for (i = 0; i < (int) nrows; i++) {
+		uint32 d;
+
+		row = order[i];
+		if (rowcount[row] == 0)
+			break;
+		for (d = 0;; d++) {
+			if (d + width > (uint32) size) {
+				used = realloc(used, 2 * size);
+				memset(used + size, 0, size);
+				size *= 2;
+			}
+			for (j = 0; j < rowcount[row]; j++)
+				if (used[d + (keys[rowkey[rowstart[row] + j]] & (width - 1))])
+					break;
+			if (j == rowcount[row])
+				break;
+		}
+		disp[row] = d;
+		for (j = 0; j < rowcount[row]; j++)
+			used[d + (keys[rowkey[rowstart[row] + j]] & (width - 1))] = 1;
+		if (d + width > nranks)
+			nranks = d + width;
+	}
+
+	ranks = calloc(nranks, sizeof *ranks);
+	for (i = 0; i < nkeys; i++)
+		ranks[disp[keys[i] >> ROWSHIFT] + (keys[i] & (width - 1))] = vals[i];
+
+	memset(&h, 0, sizeof h);
+	memcpy(h.magic, EVALTAB_MAGIC, sizeof h.magic);
+	h.rowshift = ROWSHIFT;
+	h.nrows = nrows;
+	h.nranks = nranks;
+
+	f = fopen(argv[1], "wb");
+	if (f == NULL
+			|| fwrite(&h, sizeof h, 1, f) != 1
+			|| fwrite(suitkey, sizeof *suitkey, StdDeck_N_RANKMASKS, f) != StdDeck_N_RANKMASKS
+			|| fwrite(disp, sizeof *disp, nrows, f) != nrows
+			|| fwrite(ranks, sizeof *ranks, nranks, f) != nranks
+			|| fwrite(flush, sizeof *flush, StdDeck_N_RANKMASKS, f) != StdDeck_N_RANKMASKS
+			|| fclose(f) != 0) {
+		perror(argv[1]);
+		return 1;
+	}
+	printf("mkevaltab: %d hands, %u rows, %u entries\n", nkeys, nrows, nranks);
+	return 0;
+}
@@ -0,0 +1,202 @@
+/*
+ * Writes the preflop equity table read by preflopTableLoad.
+ *
+ *   mkpreflop preflop.tab [handval.tab]
+ *
+ * Every matchup of two hands is enumerated over all of its boards.  Matchups
+ * that only differ by relabelling suits have the same result, so one of each
+ * is enumerated, on all cores, through the lookup table evaluator if given.
+ */
+#include "poker-eval/poker_defs.h"
+#include "poker-eval-api.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+static int combo_hi[N_COMBOS], combo_lo[N_COMBOS];
+static int combo_img[24][N_COMBOS];
+static int nperms;
+
+static uint32 *combos;
+static double classes[PREFLOP_CLASSES * PREFLOP_CLASSES];
+static double random_eq[PREFLOP_CLASSES];
+
+typedef struct {
+	const EvalTable *table;
+	const int *reps;
+} MatchupJob;
+
+static StdDeck_CardMask comboMask(int c) {
+	StdDeck_CardMask m;
+
+	StdDeck_CardMask_OR(m, StdDeck_MASK(combo_hi[c]), StdDeck_MASK(combo_lo[c]));
+	return m;
+}
+
+static void buildPerms(void) {
+	int s0, s1, s2, s3, c, hi, lo, t;
+	int perm[4];
+
+	for (s0 = 0; s0 < 4; s0++)
+	for (s1 = 0; s1 < 4; s1++)
+	for (s2 = 0; s2 < 4; s2++)
+	for (s3 = 0; s3 < 4; s3++) {
+		if (s0 == s1 || s0 == s2 || s0 == s3 || s1 == s2 || s1 == s3 || s2 == s3)
+			continue;
+		perm[0] = s0; perm[1] = s1; perm[2] = s2; perm[3] = s3;
+		for (c = 0; c < N_COMBOS; c++) {
+			hi = StdDeck_MAKE_CARD(StdDeck_RANK(combo_hi[c]), perm[StdDeck_SUIT(combo_hi[c])]);
+			lo = StdDeck_MAKE_CARD(StdDeck_RANK(combo_lo[c]), perm[StdDeck_SUIT(combo_lo[c])]);
+			if (hi < lo) {
+				t = hi; hi = lo; lo = t;
+			}
+			combo_img[nperms][c] = COMBO_INDEX(hi, lo);
+		}
+		nperms++;
+	}
+}
+
+/* The least image of the matchup {a, b}, a < b, as x < y */
+static void canonical(int a, int b, int *x, int *y) {
+	int k, ia, ib, t;
+
+	*x = a;
+	*y = b;
+	for (k = 0; k < nperms; k++) {
+		ia = combo_img[k][a];
+		ib = combo_img[k][b];
+		if (ia > ib) {
+			t = ia; ia = ib; ib = t;
+		}
+		if (ia < *x || (ia == *x && ib < *y)) {
+			*x = ia;
+			*y = ib;
+		}
+	}
+}
+
+static void matchupItem(void *arg, int item) {
+	MatchupJob *job = arg;
+	int a = job->reps[2 * item], b = job->reps[2 * item + 1];
+	uint32 score;
+
+	score = preflopMatchup(job->table, comboMask(a), comboMask(b));
+	combos[a * N_COMBOS + b] = score;
+	combos[b * N_COMBOS + a] = 2 * PREFLOP_BOARDS - score;
+}
+
+int main(int argc, char **argv) {
+	PreflopTableHeader h;
+	MatchupJob job;
+	double sum[PREFLOP_CLASSES * PREFLOP_CLASSES];
+	int pairs[PREFLOP_CLASSES * PREFLOP_CLASSES];
+	int cls[N_COMBOS];
+	int *reps;
+	int hi, lo, a, b, x, y, nreps = 0, nmatchups = 0;
+	long nprocs;
+	FILE *f;
+
+	if (argc != 2 && argc != 3) {
+		fprintf(stderr, "usage: mkpreflop <file> [<evaltable>]\n");
+		return 1;
+	}
+	if (argc == 3 && !evalTableLoad(argv[2])) {
+		fprintf(stderr, "mkpreflop: can't load %s\n", argv[2]);
+		return 1;
+	}
+
+	for (hi = 1; hi < StdDeck_N_CARDS; hi++) {
+		for (lo = 0; lo < hi; lo++) {
+			combo_hi[COMBO_INDEX(hi, lo)] = hi;
+			combo_lo[COMBO_INDEX(hi, lo)] = lo;
+		}
+	}
+	for (a = 0; a < N_COMBOS; a++)
+		cls[a] = preflopClass(comboMask(a));
+	buildPerms();
+
+	combos = calloc((size_t) N_COMBOS * N_COMBOS, sizeof *combos);
+	reps = malloc(sizeof *reps * N_COMBOS * N_COMBOS);
+	for (a = 0; a < N_COMBOS; a++) {
+		for (b = a + 1; b < N_COMBOS; b++) {
+			if (StdDeck_CardMask_ANY_SET(comboMask(a), comboMask(b)))
+				continue;
+			nmatchups++;
+			canonical(a, b, &x, &y);
+			if (x == a && y == b) {
+				reps[2 * nreps] = a;
+				reps[2 * nreps + 1] = b;
+				nreps++;
+			}
+		}
+	}
+
+	nprocs = sysconf(_SC_NPROCESSORS_ONLN);
+	setThreadCount(nprocs > 0 ? nprocs : 1);
+	job.table = evalTable();
+	job.reps = reps;
+	poolRun(matchupItem, &job, nreps);
+
+	/* Every other matchup is the image of one that was enumerated */
+	for (a = 0; a < N_COMBOS; a++) {
+		for (b = a + 1; b < N_COMBOS; b++) {
+			int k;
+
+			if (StdDeck_CardMask_ANY_SET(comboMask(a), comboMask(b)))
+				continue;
+			canonical(a, b, &x, &y);
+			if (x == a && y == b)
+				continue;
+			for (k = 0; k < nperms; k++) {
+				if ((combo_img[k][a] == x && combo_img[k][b] == y)
+						|| (combo_img[k][a] == y && combo_img[k][b] == x))
+					break;
+			}
+			combos[a * N_COMBOS + b] = combos[combo_img[k][a] * N_COMBOS + combo_img[k][b]];
+			combos[b * N_COMBOS + a] = combos[combo_img[k][b] * N_COMBOS + combo_img[k][a]];
+		}
+	}
+
+	memset(sum, 0, sizeof sum);
+	memset(pairs, 0, sizeof pairs);
+	for (a = 0; a < N_COMBOS; a++) {
+		for (b = 0; b < N_COMBOS; b++) {
+			if (a == b || StdDeck_CardMask_ANY_SET(comboMask(a), comboMask(b)))
+				continue;
+			sum[cls[a] * PREFLOP_CLASSES + cls[b]] += combos[a * N_COMBOS + b];
+			pairs[cls[a] * PREFLOP_CLASSES + cls[b]]++;
+		}
+	}
+	for (x = 0; x < PREFLOP_CLASSES; x++) {
+		double all = 0;
+		int n = 0;
+
+		for (y = 0; y < PREFLOP_CLASSES; y++) {
+			classes[x * PREFLOP_CLASSES + y] = sum[x * PREFLOP_CLASSES + y]
+				/ (2.0 * PREFLOP_BOARDS * pairs[x * PREFLOP_CLASSES + y]);
+			all += sum[x * PREFLOP_CLASSES + y];
+			n += pairs[x * PREFLOP_CLASSES + y];
+		}
+		random_eq[x] = all / (2.0 * PREFLOP_BOARDS * n);
+	}
+
+	memset(&h, 0, sizeof h);
+	memcpy(h.magic, PREFLOP_MAGIC, sizeof h.magic);
+	h.ncombos = N_COMBOS;
+	h.nclasses = PREFLOP_CLASSES;
+	h.nboards = PREFLOP_BOARDS;
+
+	f = fopen(argv[1], "wb");
+	if (f == NULL
+			|| fwrite(&h, sizeof h, 1, f) != 1
+			|| fwrite(combos, sizeof *combos, (size_t) N_COMBOS * N_COMBOS, f) != (size_t) N_COMBOS * N_COMBOS
+			|| fwrite(classes, sizeof *classes, PREFLOP_CLASSES * PREFLOP_CLASSES, f) != PREFLOP_CLASSES * PREFLOP_CLASSES
+			|| fwrite(random_eq, sizeof *random_eq, PREFLOP_CLASSES, f) != PREFLOP_CLASSES
+			|| fclose(f) != 0) {
+		perror(argv[1]);
+		return 1;
+	}
+	printf("mkpreflop: %d matchups, %d enumerated\n", nmatchups, nreps);
+	return 0;
+}
@@ -0,0 +1,296 @@
+/*
+ * Benchmarks the evaluators and enumerators, writing the results as JSON.
+ *
+ *   pebench [-o results.json] [-s seed] [-n scale] [-t threads] [-e evaltable] [-f filter]
+ *
+ * Every benchmark draws its spots from its own generator, seeded from -s
+ * and its name, so runs with the same seed time the same calls whatever
+ * else is run.  Boards are dealt at random for the street, which gives the
+ * mix of made hands and draws that real play sees.  Calls are timed in
+ * batches; each batch gives one sample of the time per call, and the
+ * percentiles are taken over the samples.  -n multiplies the number of
+ * calls, -f runs only the benchmarks whose names contain the filter.
+ *
+ * The results are written to stdout, or the -o file, as
+ *
+ *   { "seed": ..., "threads": ..., "table": ..., "simd": ...,
+ *     "benchmarks": [ { "name": ..., "calls": ..., "calls_per_sec": ...,
+ *                       "evals_per_sec": ..., "ns_per_call": { "mean": ...,
+ *                       "p50": ..., "p90": ..., "p99": ... } }, ... ] }
+ *
+ * evals_per_sec counts the hands each call covers, where that number is
+ * fixed (an enumeration that skips hands by suit isomorphism still counts
+ * them), and is null otherwise.
+ */
+#include "poker-eval/poker_defs.h"
+#include "poker-eval-api.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#define BENCH_SPOTS 4096
+
+typedef struct {
+	StdDeck_CardMask pocket[BENCH_SPOTS];
+	StdDeck_CardMask board[BENCH_SPOTS];
+	/* for the evaluator benchmarks: pocket and board together */
+	StdDeck_CardMask hand[BENCH_SPOTS];
+	int nboard;
+	int ncards;
+	int arg;
+	/* the evaluators specialized for ncards */
+	EvalNFn evaln;
+	EvalTypeFn evaltype;
+} BenchSpots;
+
+typedef void (*BenchFn)(const BenchSpots *s, int i);
+
+typedef struct {
+	const char *name;
+	BenchFn fn;
+	/* cards dealt to the board, and to the hand for the evaluators */
+	int nboard;
+	int ncards;
+	int arg;
+	/* calls per batch, and batches */
+	int batch;
+	int samples;
+	/* hand evaluations per call, or 0 if that varies */
+	double evals;
+} Bench;
+
+static volatile uint64 sink;
+static uint64 seed = 1;
+static int scale = 1;
+
+static void *sinkHand(int value, StdDeck_CardMask cards) {
+	sink += value;
+	return NULL;
+}
+
+static void evalN(const BenchSpots *s, int i) {
+	sink += StdDeck_StdRules_EVAL_N(s->hand[i], s->ncards);
+}
+
+static void evalType(const BenchSpots *s, int i) {
+	sink += StdDeck_StdRules_EVAL_TYPE(s->hand[i], s->ncards);
+}
+
+static void evalSizedN(const BenchSpots *s, int i) {
+	sink += s->evaln(s->hand[i]);
+}
+
+static void evalSizedType(const BenchSpots *s, int i) {
+	sink += s->evaltype(s->hand[i]);
+}
+
+static void handStrengthBench(const BenchSpots *s, int i) {
+	sink += (uint64) (handStrength(s->pocket[i], s->board[i]) * 1e6);
+}
+
+static void handPotentialBench(const BenchSpots *s, int i) {
+	HandPotential hp = handPotentialMask(s->pocket[i], s->board[i], s->arg);
+
+	sink += (uint64) (hp.ppot * 1e6);
+}
+
+static void scoreTwoCardsBench(const BenchSpots *s, int i) {
+	sink += scoreTwoCardsMask(s->pocket[i], s->board[i], sinkHand);
+}
+
+static void scoreTwoCardsIntoBench(const BenchSpots *s, int i) {
+	HandVal scores[N_COMBOS];
+
+	sink += scoreTwoCardsInto(s->pocket[i], s->board[i], scores);
+}
+
+static void evalOutsBench(const BenchSpots *s, int i) {
+	sink += evalOutsMask(s->pocket[i], s->board[i], s->arg, sinkHand);
+}
+
+static void evalOutsAllBench(const BenchSpots *s, int i) {
+	sink += evalOutsAll(s->pocket[i], s->board[i]).nouts;
+}
+
+static const Bench benches[] = {
+	{ "eval_n_5", evalN, 3, 5, 0, 4096, 400, 1 },
+	{ "eval_n_6", evalN, 4, 6, 0, 4096, 400, 1 },
+	{ "eval_n_7", evalN, 5, 7, 0, 4096, 400, 1 },
+	{ "eval_type_5", evalType, 3, 5, 0, 4096, 400, 1 },
+	{ "eval_type_6", evalType, 4, 6, 0, 4096, 400, 1 },
+	{ "eval_type_7", evalType, 5, 7, 0, 4096, 400, 1 },
+	{ "eval_sized_5", evalSizedN, 3, 5, 0, 4096, 400, 1 },
+	{ "eval_sized_6", evalSizedN, 4, 6, 0, 4096, 400, 1 },
+	{ "eval_sized_7", evalSizedN, 5, 7, 0, 4096, 400, 1 },
+	{ "eval_sized_type_5", evalSizedType, 3, 5, 0, 4096, 400, 1 },
+	{ "eval_sized_type_6", evalSizedType, 4, 6, 0, 4096, 400, 1 },
+	{ "eval_sized_type_7", evalSizedType, 5, 7, 0, 4096, 400, 1 },
+	{ "hand_strength_flop", handStrengthBench, 3, 0, 0, 8, 100, 1 + 1081 },
+	{ "hand_strength_turn", handStrengthBench, 4, 0, 0, 8, 100, 1 + 1035 },
+	{ "hand_strength_river", handStrengthBench, 5, 0, 0, 8, 100, 1 + 990 },
+	{ "hand_potential_flop_1", handPotentialBench, 3, 0, 6, 1, 100, 0 },
+	{ "hand_potential_flop_2", handPotentialBench, 3, 0, 7, 1, 20, 0 },
+	{ "hand_potential_turn_1", handPotentialBench, 4, 0, 7, 1, 100, 0 },
+	{ "score_two_cards_flop", scoreTwoCardsBench, 3, 0, 0, 8, 100, 1081 },
+	{ "score_two_cards_river", scoreTwoCardsBench, 5, 0, 0, 8, 100, 990 },
+	{ "score_two_cards_into_flop", scoreTwoCardsIntoBench, 3, 0, 0, 8, 100, 1081 },
+	{ "eval_outs_flop_river", evalOutsBench, 3, 0, 5, 8, 100, 1081 },
+	{ "eval_outs_turn_river", evalOutsBench, 4, 0, 5, 64, 100, 46 },
+	{ "eval_outs_all_flop", evalOutsAllBench, 3, 0, 0, 8, 100, 1 + 47 + 1081 }
+};
+
+static uint64 nameSeed(const char *name) {
+	uint64 h = 1469598103934665603ULL;
+
+	while (*name)
+		h = (h ^ (uint8) *name++) * 1099511628211ULL;
+	return h ^ seed;
+}
+
+/* Deals a pocket and nboard cards for each spot */
+static void benchDeal(BenchSpots *s, const Bench *b) {
+	PokerRand rng;
+	StdDeck_CardMask dealt;
+	int i, k, c;
+
+	pokerRandSeed(&rng, nameSeed(b->name));
+	s->nboard = b->nboard;
+	s->ncards = b->ncards;
+	s->arg = b->arg;
+	s->evaln = evalNSized(b->ncards);
+	s->evaltype = evalTypeSized(b->ncards);
+	for (i = 0; i < BENCH_SPOTS; i++) {
+		StdDeck_CardMask_RESET(dealt);
+		StdDeck_CardMask_RESET(s->pocket[i]);
+		StdDeck_CardMask_RESET(s->board[i]);
+		for (k = 0; k < 2 + b->nboard; k++) {
+			do
+				c = pokerRandBelow(&rng, StdDeck_N_CARDS);
+			while (StdDeck_CardMask_CARD_IS_SET(dealt, c));
+			StdDeck_CardMask_OR(dealt, dealt, StdDeck_MASK(c));
+			if (k < 2) {
+				StdDeck_CardMask_OR(s->pocket[i], s->pocket[i], StdDeck_MASK(c));
+			} else {
+				StdDeck_CardMask_OR(s->board[i], s->board[i], StdDeck_MASK(c));
+			}
+		}
+		s->hand[i] = dealt;
+	}
+}
+
+static double nowNs(void) {
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+static int compareDoubles(const void *a, const void *b) {
+	double x = *(const double *) a, y = *(const double *) b;
+
+	return x < y ? -1 : x > y;
+}
+
+static double percentile(const double *sorted, int n, double p) {
+	int i = (int) (p * (n - 1) + 0.5);
+
+	return sorted[i];
+}
+
+static void benchRun(const Bench *b, BenchSpots *s, FILE *out, int first) {
+	int samples = b->samples * scale, i, k, next = 0;
+	double *ns = malloc(samples * sizeof *ns);
+	double t0, total = 0, calls;
+
+	if (ns == NULL) {
+		fprintf(stderr, "pebench: out of memory for %s\n", b->name);
+		exit(1);
+	}
+	benchDeal(s, b);
+	/* one batch to warm the caches and start the pool */
+	for (k = 0; k < b->batch; k++)
+		b->fn(s, k % BENCH_SPOTS);
+	for (i = 0; i < samples; i++) {
+		t0 = nowNs();
+		for (k = 0; k < b->batch; k++) {
+			b->fn(s, next);
+			next = (next + 1) % BENCH_SPOTS;
+		}
+		ns[i] = (nowNs() - t0) / b->batch;
+		total += ns[i] * b->batch;
+	}
+	qsort(ns, samples, sizeof *ns, compareDoubles);
+	calls = (double) samples * b->batch;
+
+	fprintf(out, "%s\n    { \"name\": \"%s\", \"calls\": %.0f, \"calls_per_sec\": %.1f, ",
+		first ? "" : ",", b->name, calls, calls / total * 1e9);
+	if (b->evals > 0)
+		fprintf(out, "\"evals_per_sec\": %.1f, ", calls * b->evals / total * 1e9);
+	else
+		fprintf(out, "\"evals_per_sec\": null, ");
+	fprintf(out, "\"ns_per_call\": { \"mean\": %.1f, \"p50\": %.1f, \"p90\": %.1f, \"p99\": %.1f } }",
+		total / calls, percentile(ns, samples, 0.5), percentile(ns, samples, 0.9), percentile(ns, samples, 0.99));
+	fprintf(stderr, "%-28s %12.1f ns/call\n", b->name, total / calls);
+	free(ns);
+}
+
+int main(int argc, char **argv) {
+	BenchSpots *spots;
+	const char *outpath = NULL, *filter = NULL;
+	FILE *out = stdout;
+	int opt, i, threads = 1, first = 1;
+
+	while ((opt = getopt(argc, argv, "o:s:n:t:e:f:")) != -1) {
+		switch (opt) {
+		case 'o':
+			outpath = optarg;
+			break;
+		case 's':
+			seed = strtoull(optarg, NULL, 0);
+			break;
+		case 'n':
+			scale = atoi(optarg) > 0 ? atoi(optarg) : 1;
+			break;
+		case 't':
+			threads = atoi(optarg);
+			break;
+		case 'e':
+			if (!evalTableLoad(optarg)) {
+				fprintf(stderr, "pebench: can't load %s\n", optarg);
+				return 1;
+			}
+			break;
+		case 'f':
+			filter = optarg;
+			break;
+		default:
+			fprintf(stderr, "usage: pebench [-o results.json] [-s seed] [-n scale] [-t threads] [-e evaltable] [-f filter]\n");
+			return 1;
+		}
+	}
+	setThreadCount(threads);
+	spots = malloc(sizeof *spots);
+	if (outpath)
+		out = fopen(outpath, "w");
+	if (spots == NULL || out == NULL) {
+		perror(outpath ? outpath : "pebench");
+		return 1;
+	}
+
+	fprintf(out, "{\n  \"seed\": %llu,\n  \"threads\": %d,\n  \"table\": %s,\n  \"simd\": \"%s\",\n  \"benchmarks\": [",
+		(unsigned long long) seed, getThreadCount(), evalTableLoaded() ? "true" : "false", simdEvalPath());
+	for (i = 0; i < (int) (sizeof benches / sizeof benches[0]); i++) {
+		if (filter && strstr(benches[i].name, filter) == NULL)
+			continue;
+		benchRun(&benches[i], spots, out, first);
+		first = 0;
+	}
+	fprintf(out, "\n  ]\n}\n");
+	if (fclose(out) != 0) {
+		perror(outpath ? outpath : "pebench");
+		return 1;
+	}
+	return 0;
+}
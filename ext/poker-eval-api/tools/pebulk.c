@@ -0,0 +1,336 @@
+/*
+ * Computes hand strength, hand potential and equity for a stream of spots.
+ *
+ *   pebulk [-b] [-f hs,hp,eq] [-t threads] [-c entries] [-e evaltable] [-p preflop] [input]
+ *
+ * Spots are read from input, which is mapped, or else from stdin: one per
+ * line as the pocket and the board ("AhKd 7c5s2h", or "AhKd" preflop), or
+ * with -b as 16 byte records of the pocket's and the board's cards_n.
+ * Blank lines are skipped.  For each spot five floats are written to
+ * stdout, in input order:
+ *
+ *   hs      handStrength, on a board of 3 to 5 cards
+ *   ppot    handPotential's positive and negative potential, 0 on the river
+ *   npot
+ *   ehs     hs + (1 - hs) * ppot, as effective_hand_strength computes it
+ *   equity  against one random hand, dealt out to the river; preflop only
+ *           with a preflop table
+ *
+ * Fields that weren't asked for with -f (hs and hp by default), that don't
+ * apply to the spot or whose spot can't be parsed (or, with -b, has bits
+ * set that aren't cards) are -1.
+ *
+ * Spots are read BULK_BATCH at a time and spread over the worker pool, and
+ * the next batch is only read once this one is written, so memory stays
+ * bounded and a slow reader downstream holds back the input.  -c turns on
+ * the spot cache, which pays off when spots repeat, as they do in hand
+ * histories.
+ */
+#include "poker-eval/poker_defs.h"
+#include "poker-eval-api.h"
+#include <fcntl.h>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#define BULK_BATCH 4096
+#define BULK_FIELDS 5
+#define BULK_MAX_LINE 256
+
+#define FIELD_HS 1
+#define FIELD_HP 2
+#define FIELD_EQ 4
+
+typedef struct {
+	StdDeck_CardMask pocket;
+	StdDeck_CardMask board;
+	int valid;
+} BulkSpot;
+
+typedef struct {
+	/* the input file, mapped, or else stdin */
+	const char *map;
+	size_t size;
+	size_t pos;
+	FILE *fp;
+	int binary;
+	char line[BULK_MAX_LINE];
+} BulkInput;
+
+typedef struct {
+	int fields;
+	BulkSpot spots[BULK_BATCH];
+	float out[BULK_BATCH][BULK_FIELDS];
+} BulkJob;
+
+/* Parses len characters of cards, such as "7c5s2h", into out */
+static int parseCards(const char *s, size_t len, StdDeck_CardMask *out) {
+	static const char ranks[] = "23456789TJQKA", suits[] = "hdcs";
+	const char *r, *u;
+	int card;
+	size_t i;
+
+	StdDeck_CardMask_RESET(*out);
+	if (len % 2)
+		return 0;
+	for (i = 0; i < len; i += 2) {
+		r = s[i] ? strchr(ranks, s[i] >= 'a' ? s[i] - 'a' + 'A' : s[i]) : NULL;
+		u = s[i + 1] ? strchr(suits, s[i + 1] < 'a' ? s[i + 1] - 'A' + 'a' : s[i + 1]) : NULL;
+		if (r == NULL || u == NULL)
+			return 0;
+		card = StdDeck_MAKE_CARD(r - ranks, u - suits);
+		if (StdDeck_CardMask_CARD_IS_SET(*out, card))
+			return 0;
+		StdDeck_CardMask_OR(*out, *out, StdDeck_MASK(card));
+	}
+	return 1;
+}
+
+/* Parses a line of pocket and board; returns 0 for a blank line */
+static int parseLine(char *line, BulkSpot *spot) {
+	char *pocket, *board, *extra;
+
+	spot->valid = 0;
+	pocket = strtok(line, " \t\r\n");
+	if (pocket == NULL)
+		return 0;
+	board = strtok(NULL, " \t\r\n");
+	extra = board ? strtok(NULL, " \t\r\n") : NULL;
+	StdDeck_CardMask_RESET(spot->board);
+	spot->valid = extra == NULL && parseCards(pocket, strlen(pocket), &spot->pocket)
+		&& (board == NULL || parseCards(board, strlen(board), &spot->board));
+	return 1;
+}
+
+/* Whether a binary record's mask holds only cards, as parsing would give */
+static int cardsOnly(uint64 cards_n) {
+	static uint64 deck = 0;
+	int i;
+
+	if (deck == 0)
+		for (i = 0; i < StdDeck_N_CARDS; i++)
+			deck |= StdDeck_MASK(i).cards_n;
+	return (cards_n & ~deck) == 0;
+}
+
+/* Reads the next spot: returns 1, 0 at the end of the input, or -1 for a
+ * partial binary record */
+static int bulkRead(BulkInput *in, BulkSpot *spot) {
+	uint64 rec[2];
+	size_t len;
+	const char *nl;
+
+	for (;;) {
+		if (in->binary) {
+			if (in->map) {
+				if (in->pos == in->size)
+					return 0;
+				if (in->size - in->pos < sizeof rec)
+					return -1;
+				memcpy(rec, in->map + in->pos, sizeof rec);
+				in->pos += sizeof rec;
+			} else {
+				len = fread(rec, 1, sizeof rec, in->fp);
+				if (len == 0)
+					return 0;
+				if (len < sizeof rec)
+					return -1;
+			}
+			spot->pocket.cards_n = rec[0];
+			spot->board.cards_n = rec[1];
+			spot->valid = cardsOnly(rec[0]) && cardsOnly(rec[1]);
+			return 1;
+		}
+
+		if (in->map) {
+			if (in->pos == in->size)
+				return 0;
+			nl = memchr(in->map + in->pos, '\n', in->size - in->pos);
+			len = (nl ? (size_t) (nl - in->map) : in->size) - in->pos;
+			if (len >= BULK_MAX_LINE)
+				len = BULK_MAX_LINE - 1;
+			memcpy(in->line, in->map + in->pos, len);
+			in->line[len] = '\0';
+			in->pos = nl ? (size_t) (nl - in->map) + 1 : in->size;
+		} else if (fgets(in->line, BULK_MAX_LINE, in->fp) == NULL) {
+			return 0;
+		} else if (strchr(in->line, '\n') == NULL && !feof(in->fp)) {
+			/* too long to be a spot; drop the rest of it */
+			int c;
+
+			while ((c = getc(in->fp)) != EOF && c != '\n')
+				;
+		}
+		if (parseLine(in->line, spot))
+			return 1;
+	}
+}
+
+static void bulkItem(void *arg, int item) {
+	BulkJob *job = arg;
+	const BulkSpot *spot = &job->spots[item];
+	float *out = job->out[item];
+	int nboard = StdDeck_numCards(spot->board), k;
+	double hs = -1, ppot = -1, npot = -1;
+
+	for (k = 0; k < BULK_FIELDS; k++)
+		out[k] = -1;
+	if (!spot->valid || StdDeck_numCards(spot->pocket) != 2 || StdDeck_CardMask_ANY_SET(spot->pocket, spot->board)
+			|| nboard > 5 || (nboard > 0 && nboard < 3))
+		return;
+
+	if (nboard >= 3 && (job->fields & FIELD_HS)) {
+		hs = handStrength(spot->pocket, spot->board);
+		out[0] = hs;
+	}
+	if (nboard >= 3 && (job->fields & FIELD_HP)) {
+		if (nboard == 5) {
+			ppot = npot = 0;
+		} else {
+			HandPotential hp = handPotentialMask(spot->pocket, spot->board, nboard == 4 ? 7 : 6);
+			ppot = isnan(hp.ppot) ? 1.0 : hp.ppot;
+			npot = isnan(hp.npot) ? 1.0 : hp.npot;
+		}
+		out[1] = ppot;
+		out[2] = npot;
+	}
+	if (hs >= 0 && ppot >= 0)
+		out[3] = hs + (1 - hs) * ppot;
+	if (job->fields & FIELD_EQ) {
+		if (nboard >= 3)
+			out[4] = multiwayEquity(spot->pocket, spot->board, 1, 1).equity;
+		else if (preflopTableLoaded())
+			out[4] = preflopEquityVsRandom(spot->pocket);
+	}
+}
+
+static int parseFields(const char *s) {
+	char buf[64], *f;
+	int fields = 0;
+
+	snprintf(buf, sizeof buf, "%s", s);
+	for (f = strtok(buf, ","); f; f = strtok(NULL, ",")) {
+		if (strcmp(f, "hs") == 0)
+			fields |= FIELD_HS;
+		else if (strcmp(f, "hp") == 0)
+			fields |= FIELD_HP;
+		else if (strcmp(f, "eq") == 0)
+			fields |= FIELD_EQ;
+		else
+			return 0;
+	}
+	return fields;
+}
+
+static void usage(void) {
+	fprintf(stderr, "usage: pebulk [-b] [-f hs,hp,eq] [-t threads] [-c entries] [-e evaltable] [-p preflop] [input]\n");
+	exit(1);
+}
+
+int main(int argc, char **argv) {
+	BulkInput in;
+	BulkJob *job;
+	struct stat st;
+	long nprocs, nspots = 0, ninvalid = 0;
+	int opt, fd, n, r = 1, i, threads = 0;
+
+	memset(&in, 0, sizeof in);
+	in.fp = stdin;
+	job = malloc(sizeof *job);
+	if (job == NULL) {
+		perror("pebulk");
+		return 1;
+	}
+	job->fields = FIELD_HS | FIELD_HP;
+	while ((opt = getopt(argc, argv, "bf:t:c:e:p:")) != -1) {
+		switch (opt) {
+		case 'b':
+			in.binary = 1;
+			break;
+		case 'f':
+			job->fields = parseFields(optarg);
+			if (job->fields == 0)
+				usage();
+			break;
+		case 't':
+			threads = atoi(optarg);
+			break;
+		case 'c':
+			if (!spotCacheSetSize(atol(optarg))) {
+				fprintf(stderr, "pebulk: can't make a spot cache of %s entries\n", optarg);
+				return 1;
+			}
+			break;
+		case 'e':
+			if (!evalTableLoad(optarg)) {
+				fprintf(stderr, "pebulk: can't load %s\n", optarg);
+				return 1;
+			}
+			break;
+		case 'p':
+			if (!preflopTableLoad(optarg)) {
+				fprintf(stderr, "pebulk: can't load %s\n", optarg);
+				return 1;
+			}
+			break;
+		default:
+			usage();
+		}
+	}
+	if (argc - optind > 1)
+		usage();
+
+	if (optind < argc) {
+		fd = open(argv[optind], O_RDONLY);
+		if (fd < 0 || fstat(fd, &st) != 0) {
+			perror(argv[optind]);
+			return 1;
+		}
+		in.size = st.st_size;
+		if (in.size > 0) {
+			in.map = mmap(NULL, in.size, PROT_READ, MAP_PRIVATE, fd, 0);
+			if (in.map == MAP_FAILED) {
+				perror(argv[optind]);
+				return 1;
+			}
+			madvise((void *) in.map, in.size, MADV_SEQUENTIAL);
+		} else {
+			/* nothing to map; read it as an empty stream */
+			in.fp = fdopen(fd, "rb");
+		}
+		if (in.map)
+			close(fd);
+	}
+
+	nprocs = sysconf(_SC_NPROCESSORS_ONLN);
+	setThreadCount(threads > 0 ? threads : nprocs > 0 ? nprocs : 1);
+
+	while (r > 0) {
+		for (n = 0; n < BULK_BATCH && (r = bulkRead(&in, &job->spots[n])) > 0; n++)
+			;
+		if (n == 0)
+			break;
+		poolRun(bulkItem, job, n);
+		if (fwrite(job->out, sizeof job->out[0], n, stdout) != (size_t) n) {
+			perror("pebulk");
+			return 1;
+		}
+		for (i = 0; i < n; i++)
+			ninvalid += job->out[i][0] < 0 && job->out[i][1] < 0 && job->out[i][4] < 0;
+		nspots += n;
+	}
+	if (r < 0) {
+		fprintf(stderr, "pebulk: the input ends in a partial record\n");
+		return 1;
+	}
+	if (fflush(stdout) != 0) {
+		perror("pebulk");
+		return 1;
+	}
+	fprintf(stderr, "pebulk: %ld spots, %ld with no results\n", nspots, ninvalid);
+	return 0;
+}
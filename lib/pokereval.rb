@@ -17,6 +17,35 @@ module PokerEvalAPI
 		layout :ppot, :float, :npot, :float
 	end
 
+	class EquityTally < FFI::Struct
+		layout :ahead, :int, :tied, :int, :behind, :int
+	end
+
+	class RangeEquity < FFI::Struct
+		layout :equity, :double, :exact, :int, :runouts, :int
+	end
+
+	class MultiwayEquity < FFI::Struct
+		layout :win, :double, :tie, :double, :lose, :double, :equity, :double
+	end
+
+	class EquityEstimate < FFI::Struct
+		layout :equity, :double, :std_error, :double, :low, :double, :high, :double, :samples, :int
+	end
+
+	class HsDistribution < FFI::Struct
+		layout :ehs, :double, :ehs2, :double, :runouts, :int
+	end
+
+	class EvalStatCounters < FFI::Struct
+		layout :calls, :uint64, :evals, :uint64, :combos, :uint64, :ns, :uint64, :cycles, :uint64, :callback_ns, :uint64
+	end
+
+	class SpotCacheStats < FFI::Struct
+		layout :hits, :uint64, :shared_hits, :uint64, :misses, :uint64, :inserts, :uint64, :evictions, :uint64,
+			:size, :long, :used, :long, :shared_size, :long, :shared_used, :long
+	end
+
 	# A struct representing a cardmask
 	class CardMask < FFI::Struct
 		layout :cards_n, :uint64
@@ -44,7 +73,9 @@ module PokerEvalAPI
 
 		# Returns a string representation of these cards
 		def to_s
-			return PokerEvalAPI.wrap_StdDeck_maskString(self).gsub(/\s+/, '')
+			buf = FFI::MemoryPointer.new(:char, 2 * 52 + 1)
+			PokerEvalAPI.maskToText(self, buf, buf.size)
+			return buf.read_string
 		end
 
 		def type
@@ -57,6 +88,11 @@ module PokerEvalAPI
 			return PokerEvalAPI.wrap_StdDeck_numCards(self)
 		end
 
+		# Returns true if there are no cards in this set
+		def empty?
+			return self[:cards_n] == 0
+		end
+
 		# Adds a single card to this set by specifying its index
 		#
 		#	@param i [Integer] The card index to add
@@ -85,25 +121,192 @@ module PokerEvalAPI
 		@results
 	end
 
+	# The number of two-card hands, and so the length of a weight vector
+	N_COMBOS = 1326
+
+	# The kinds of result in the spot cache
+	SPOT_HS = 1
+	SPOT_HP = 2
+
+	# The most opponents multiwayEquity takes
+	MW_MAX_OPPONENTS = 4
+
+	# The entry points counted by evalStatsRead, in order
+	STAT_ENTRIES = [:hand_strength, :hand_potential, :score_two_cards, :eval_outs, :parse]
+
+	# The size of a job's result, and its states as from jobState
+	JOB_RESULTS = 4
+	JOB_STATES = [:queued, :running, :done, :cancelled]
+
+	# Returns the raw cards_n mask of every card, by card index
+	def self.card_masks
+		@card_masks ||= (0...52).map {|i| wrap_StdDeck_MASK(i).cards_n }
+	end
+
+	# Returns a Hash mapping the raw cards_n mask of every two-card hand to its
+	# position in a weight vector (COMBO_INDEX in the C extension)
+	def self.combo_indices
+		@combo_indices ||= begin
+			indices = {}
+			card_masks.each_with_index do |hi_mask, hi|
+				hi.times {|lo| indices[hi_mask | card_masks[lo]] = hi * (hi - 1) / 2 + lo }
+			end
+			indices
+		end
+	end
+
+	# Hand-type counts for the flop, turn and river (9 types per street), and the
+	# single next cards that improve the hand type
+	class OutsResult < FFI::Struct
+		layout :counts, [:int, 27],
+		:totals, [:int, 3],
+		:outs, CardMask,
+		:nouts, :int
+	end
+
 	ffi_lib File.dirname(__FILE__) + '/../ext/poker-eval-api/poker-eval-api.so'
 
+	# The enumerations are attached with blocking: true, so that they release the GVL and
+	# several Ruby threads can run them at once. Nothing they share is written to, and they
+	# return results by value or into buffers the caller owns. scoreTwoCards and evalOuts call
+	# back into Ruby for every hand, so they keep the GVL; scoreTwoCardsInto and evalOutsAll
+	# are their thread friendly equivalents.
 	callback :completion_function, [:int, CardMask.by_value], :void
 	attach_function :TextToPokerEval, [:string], CardMask.by_value
 	attach_function :StdDeck_StdRules_EVAL_TYPE, [CardMask.by_value, :int], :int
 	attach_function :StdDeck_StdRules_EVAL_N, [CardMask.by_value, :int], :int
-	attach_function :handStrength, [CardMask.by_value, CardMask.by_value], :double
-	attach_function :handPotential, [:string, :string, :int], HandPotential.by_value
+	attach_function :handStrength, [CardMask.by_value, CardMask.by_value], :double, blocking: true
+	attach_function :handStrengthWeighted, [CardMask.by_value, CardMask.by_value, :pointer], :double, blocking: true
+	attach_function :rangeEquity, [:pointer, :pointer, CardMask.by_value, :int, :int, :uint64, :pointer], RangeEquity.by_value, blocking: true
+	attach_function :multiwayEquity, [CardMask.by_value, CardMask.by_value, :int, :int], MultiwayEquity.by_value, blocking: true
+	attach_function :handPotential, [:string, :string, :int], HandPotential.by_value, blocking: true
+	attach_function :handPotentialMask, [CardMask.by_value, CardMask.by_value, :int], HandPotential.by_value, blocking: true
 	attach_function :evalOuts, [:string, :int, :string, :int, :int, :completion_function], :int
+	attach_function :evalOutsMask, [CardMask.by_value, CardMask.by_value, :int, :completion_function], :int
+	attach_function :evalOutsAll, [CardMask.by_value, CardMask.by_value], OutsResult.by_value, blocking: true
 	attach_function :scoreTwoCards, [:string, :string, :completion_function], :int
+	attach_function :scoreTwoCardsMask, [CardMask.by_value, CardMask.by_value, :completion_function], :int
+	attach_function :scoreTwoCardsInto, [CardMask.by_value, CardMask.by_value, :pointer], :int, blocking: true
+	attach_function :monteCarloEquity, [CardMask.by_value, CardMask.by_value, :int, :int, :uint64], EquityTally.by_value, blocking: true
+	attach_function :monteCarloEquityAdaptive, [CardMask.by_value, CardMask.by_value, :int, :double, :double, :int, :int, :uint64], EquityEstimate.by_value, blocking: true
 	attach_function :Eval_Str_N, [:string], :int
 	attach_function :Eval_Str_Type, [:string], :int
+	attach_function :Eval_Mask_N, [CardMask.by_value], :int
+	attach_function :Eval_Mask_Type, [CardMask.by_value], :int
+	attach_function :cardsToMask, [:pointer, :int, :pointer], :int
 	attach_function :TextToPtr, [:string], :pointer
+	attach_function :freeCardMask, [:pointer], :void
+	attach_function :maskToText, [CardMask.by_value, :pointer, :int], :int
 	attach_function :wrap_StdDeck_MAKE_CARD, [:int, :int], :int
 	attach_function :wrap_StdDeck_MASK, [:int], CardMask.by_value
 	attach_function :wrap_StdDeck_maskString, [CardMask.by_value], :string
 	attach_function :wrap_StdDeck_numCards, [CardMask.by_value], :int
 	attach_function :wrap_StdDeck_RANK, [:uint], :uint
 	attach_function :wrap_StdDeck_SUIT, [:uint], :uint
+	attach_function :setThreadCount, [:int], :void
+	attach_function :getThreadCount, [], :int
+	attach_function :setSuitIsomorphism, [:int], :void
+	attach_function :getSuitIsomorphism, [], :int
+	attach_function :evalTableLoad, [:string], :int, blocking: true
+	attach_function :evalTableLoaded, [], :int
+	attach_function :setTableEval, [:int], :void
+	attach_function :getTableEval, [], :int
+	attach_function :setSimdEval, [:int], :void
+	attach_function :getSimdEval, [], :int
+	attach_function :simdEvalPath, [], :string
+	attach_function :spotCacheSetSize, [:long], :int
+	attach_function :spotCacheSize, [], :long
+	attach_function :spotCacheOpen, [:string, :long], :int
+	attach_function :spotCacheClose, [], :void
+	attach_function :spotCacheClear, [], :void
+	attach_function :spotCacheStats, [], SpotCacheStats.by_value
+	attach_function :spotCacheResetStats, [], :void
+	attach_function :spotCachePrewarm, [CardMask.by_value, :int], :long, blocking: true
+	attach_function :preflopTableLoad, [:string], :int, blocking: true
+	attach_function :preflopTableLoaded, [], :int
+	attach_function :preflopClass, [CardMask.by_value], :int
+	attach_function :preflopEquity, [CardMask.by_value, CardMask.by_value], :double
+	attach_function :preflopEquityVsRandom, [CardMask.by_value], :double
+	attach_function :preflopClassEquity, [:int, :int], :double
+	attach_function :preflopClassEquityVsRandom, [:int], :double
+	attach_function :evalBatch, [:pointer, :pointer, :pointer, :int], :void, blocking: true
+	attach_function :evalTypeBatch, [:pointer, :pointer, :pointer, :int], :void, blocking: true
+	attach_function :hsDistribution, [CardMask.by_value, CardMask.by_value, :int, :pointer], HsDistribution.by_value, blocking: true
+	attach_function :hsFeaturesWrite, [:string, :int, :int], :long, blocking: true
+	attach_function :evalStatsRead, [:pointer], :int
+	attach_function :evalStatsReset, [], :void
+	attach_function :rangeParse, [:string, CardMask.by_value, :pointer], :int
+	attach_function :rangeMasks, [:pointer, :pointer, :pointer], :int
+	attach_function :rangeCacheClear, [], :void
+	# Jobs run on native threads of their own; only waiting for one blocks
+	attach_function :handPotentialJob, [CardMask.by_value, CardMask.by_value, :int], :pointer
+	attach_function :multiwayEquityJob, [CardMask.by_value, CardMask.by_value, :int, :int], :pointer
+	attach_function :jobState, [:pointer], :int
+	attach_function :jobProgress, [:pointer], :double
+	attach_function :jobEstimate, [:pointer, :pointer], :double
+	attach_function :jobCancel, [:pointer], :void
+	attach_function :jobWait, [:pointer, :double], :int, blocking: true
+	attach_function :jobFree, [:pointer], :void, blocking: true
+	attach_function :deckNew, [CardMask.by_value, :uint64], :pointer
+	attach_function :deckFree, [:pointer], :void
+	attach_function :deckSeed, [:pointer, :uint64], :void
+	attach_function :deckSetDead, [:pointer, CardMask.by_value], :void
+	attach_function :deckLiveCount, [:pointer], :int
+	attach_function :deckDeal, [:pointer, :pointer, :int, :pointer, :int], :int
+
+	# Builds a CardMask from card indices (0 to 51, as from wrap_StdDeck_MAKE_CARD)
+	#
+	# @param indices [Array<Integer>] The cards
+	# @return [CardMask]
+	# @raise [ArgumentError] If an index isn't a card or appears twice
+	def self.cards_to_mask(indices)
+		raise ArgumentError, "not a card index in #{indices.inspect}" unless indices.all? {|i| i.is_a?(Integer) && i.between?(0, 51) }
+		buf = FFI::MemoryPointer.new(:uint8, [indices.length, 1].max)
+		buf.write_array_of_uint8(indices)
+		mask = CardMask.new
+		raise ArgumentError, "repeated card in #{indices.inspect}" if cardsToMask(buf, indices.length, mask) == 0
+		return mask
+	end
+
+	# Parses cards into a CardMask allocated by the extension, freed when the pointer is collected
+	#
+	# @param str [String] The cards
+	# @return [FFI::AutoPointer]
+	def self.text_to_ptr(str)
+		return FFI::AutoPointer.new(TextToPtr(str), method(:freeCardMask))
+	end
+
+	# Scores many hands in one call
+	#
+	# @param masks [Array] The hands, as PokerEvalAPI::CardMask objects or raw cards_n integers
+	# @param n_cards [Array] (optional) The number of cards in each hand. Counted from the masks if not given
+	# @return [Array] The score of each hand, for use in comparisons
+	def self.eval_batch(masks, n_cards = nil)
+		return batch_call(:evalBatch, masks, n_cards, :uint32)
+	end
+
+	# Classifies many hands in one call
+	#
+	# @param masks [Array] The hands, as PokerEvalAPI::CardMask objects or raw cards_n integers
+	# @param n_cards [Array] (optional) The number of cards in each hand. Counted from the masks if not given
+	# @return [Array] The type of each hand, as an index into PokerEval::HandTypes
+	def self.eval_type_batch(masks, n_cards = nil)
+		return batch_call(:evalTypeBatch, masks, n_cards, :int)
+	end
+
+	def self.batch_call(func, masks, n_cards, out_type)
+		n = masks.length
+		return [] if n == 0
+		in_buf = FFI::MemoryPointer.new(:uint64, n)
+		in_buf.write_array_of_uint64(masks.map {|m| m.is_a?(CardMask) ? m.cards_n : m })
+		if n_cards
+			count_buf = FFI::MemoryPointer.new(:int, n)
+			count_buf.write_array_of_int(n_cards)
+		end
+		out_buf = FFI::MemoryPointer.new(out_type, n)
+		send(func, in_buf, count_buf, out_buf, n)
+		return out_buf.send("read_array_of_#{out_type}", n)
+	end
 
 end
 
@@ -137,6 +340,8 @@ class PokerEval
 		'2' => 2
 	}
 
+	# Sklansky's hand groups. Once a preflop table is loaded, PokerEval.hand_groups ranks
+	# the hands by their equity instead.
 	HandGroups = {
 		1 => %w{AA KK QQ JJ AKs},
 		2 => %w{TT AQs AJs KQs AKo},
@@ -147,13 +352,384 @@ class PokerEval
 		7 => %w{44 33 22 K8s K7s K6s K5s K4s K3s K2s Q8s T7s 64s 53s 43s J9o T9o 98o}
 	}
 
+	# A computation running in the background, from #hand_potential_async or
+	# #multiway_equity_async. It is cancelled if collected while still running.
+	class Job
+
+		def initialize(ptr, &convert)
+			@ptr = FFI::AutoPointer.new(ptr, PokerEvalAPI.method(:jobFree))
+			@convert = convert
+		end
+
+		# @return [Symbol] :queued, :running, :done or :cancelled
+		def state
+			return PokerEvalAPI::JOB_STATES[PokerEvalAPI.jobState(@ptr)]
+		end
+
+		def done?
+			return state == :done
+		end
+
+		def cancelled?
+			return state == :cancelled
+		end
+
+		# @return [Float] The fraction of the outer loop of the enumeration finished so far
+		def progress
+			return PokerEvalAPI.jobProgress(@ptr)
+		end
+
+		# Returns the result once the job is done, or else an estimate from the parts of the
+		# enumeration finished so far, which are spread evenly over it
+		#
+		# @return [Object, nil] The result, in the form the synchronous method returns it, or nil if
+		#   nothing is finished yet
+		def estimate
+			buf = FFI::MemoryPointer.new(:double, PokerEvalAPI::JOB_RESULTS)
+			return nil if PokerEvalAPI.jobEstimate(@ptr, buf) == 0
+			return @convert.call(buf.read_array_of_double(PokerEvalAPI::JOB_RESULTS))
+		end
+
+		# Asks the job to stop. What it finished is kept for #estimate.
+		def cancel
+			PokerEvalAPI.jobCancel(@ptr)
+			return self
+		end
+
+		# Waits for the job to be done or cancelled, without holding the GVL
+		#
+		# @param timeout [Float] (optional) The most seconds to wait
+		# @return [Boolean] Whether the job has finished
+		def wait(timeout = nil)
+			return PokerEvalAPI.jobWait(@ptr, timeout ? timeout * 1000.0 : -1) != 0
+		end
+
+		# Waits for the job and returns its result
+		#
+		# @param timeout [Float] (optional) The most seconds to wait
+		# @return [Object, nil] The result, or nil if the job timed out or was cancelled
+		def value(timeout = nil)
+			return nil unless wait(timeout) && done?
+			return estimate
+		end
+
+	end
+
+	# A native deck of the cards left once some are dead, dealing random layouts of sets of
+	# cards with its own seedable generator. Every layout is dealt from all the live cards.
+	# A deck isn't safe to share between threads.
+	class Deck
+
+		# The layouts dealt in one native call by #each_deal
+		BATCH = 1024
+
+		# @param dead [String, PokerEvalAPI::CardMask] (optional) Cards to leave out of the deck
+		# @param seed [Integer] (optional) Seed for the deals, for repeatable results
+		def initialize(dead = nil, seed = nil)
+			ptr = PokerEvalAPI.deckNew(dead_mask(dead), seed || rand(2**64))
+			raise NoMemoryError, "can't allocate a deck" if ptr.null?
+			@ptr = FFI::AutoPointer.new(ptr, PokerEvalAPI.method(:deckFree))
+		end
+
+		def seed=(seed)
+			PokerEvalAPI.deckSeed(@ptr, seed)
+		end
+
+		# Puts every card back but the dead ones
+		def dead=(dead)
+			PokerEvalAPI.deckSetDead(@ptr, dead_mask(dead))
+		end
+
+		# @return [Integer] The number of live cards
+		def live
+			return PokerEvalAPI.deckLiveCount(@ptr)
+		end
+
+		# Deals layouts of sets of cards
+		#
+		# @param set_sizes [Array] The number of cards in each set, eg. [2, 2, 5]
+		# @param iterations [Integer] (default: 1) The number of layouts
+		# @return [Array] The cards_n mask of each set, for each layout
+		# @raise [ArgumentError] If a layout takes more cards than are live
+		def deal(set_sizes, iterations = 1)
+			# the buffers are kept for the next call, as dealing a hand or two at a time is common
+			if @sizes.nil? || @sizes.size < 4 * set_sizes.length || @out.size < 8 * set_sizes.length * iterations
+				@sizes, @out = buffers(set_sizes, iterations)
+			else
+				@sizes.write_array_of_int(set_sizes)
+			end
+			sizes, out = @sizes, @out
+			deal_into(sizes, set_sizes.length, out, iterations)
+			return out.read_array_of_uint64(set_sizes.length * iterations).each_slice(set_sizes.length).to_a
+		end
+
+		# Deals num_iter layouts, a batch at a time, yielding each as an array of CardMasks. Unless
+		# fresh is set, the same CardMasks are refilled for every layout, so that dealing allocates
+		# nothing per layout; clone any that are kept after the block.
+		#
+		# @param set_sizes [Array] The number of cards in each set
+		# @param num_iter [Integer] The number of layouts
+		# @param fresh [Boolean] (default: false) Yield new CardMasks for every layout
+		# @raise [ArgumentError] If a layout takes more cards than are live
+		def each_deal(set_sizes, num_iter, fresh = false)
+			nsets = set_sizes.length
+			sizes, out = buffers(set_sizes, [num_iter, BATCH].min)
+			masks = Array.new(nsets) { PokerEvalAPI::CardMask.new }
+			left = num_iter
+			while left > 0
+				n = [left, BATCH].min
+				deal_into(sizes, nsets, out, n)
+				out.read_array_of_uint64(nsets * n).each_slice(nsets) do |layout|
+					masks = Array.new(nsets) { PokerEvalAPI::CardMask.new } if fresh
+					layout.each_with_index {|m, i| masks[i][:cards_n] = m }
+					yield masks.dup
+				end
+				left -= n
+			end
+		end
+
+		private
+
+		def dead_mask(dead)
+			return PokerEvalAPI::CardMask.new if dead.nil?
+			return dead if dead.is_a?(PokerEvalAPI::CardMask)
+			return PokerEvalAPI.TextToPokerEval(dead)
+		end
+
+		def buffers(set_sizes, iterations)
+			sizes = FFI::MemoryPointer.new(:int, [set_sizes.length, 1].max)
+			sizes.write_array_of_int(set_sizes)
+			return sizes, FFI::MemoryPointer.new(:uint64, [set_sizes.length * iterations, 1].max)
+		end
+
+		def deal_into(sizes, nsets, out, iterations)
+			if PokerEvalAPI.deckDeal(@ptr, sizes, nsets, out, iterations) < 0
+				raise ArgumentError, "can't deal #{sizes.read_array_of_int(nsets).inspect} from #{live} cards"
+			end
+		end
+
+	end
+
+	# Sets the size of the native worker pool used by the exhaustive enumerations
+	# (handPotential, handStrength and scoreTwoCards). 1, the default, runs them on the calling thread.
+	# The POKEREVAL_THREADS environment variable sets the initial size.
+	#
+	# @param n [Integer] The number of threads
+	def self.threads=(n)
+		PokerEvalAPI.setThreadCount(n)
+	end
+
+	# @return [Integer] The size of the native worker pool
+	def self.threads
+		return PokerEvalAPI.getThreadCount
+	end
+
+	# Turns suit isomorphism in handStrength and handPotential on or off. When on (the default),
+	# opponent hands and runouts that differ only by exchanging suits our cards and the board
+	# don't tell apart are evaluated once and counted for each of them. Results are the same either way.
+	#
+	# @param on [Boolean]
+	def self.suit_isomorphism=(on)
+		PokerEvalAPI.setSuitIsomorphism(on ? 1 : 0)
+	end
+
+	# @return [Boolean] Whether the enumerations use suit isomorphism
+	def self.suit_isomorphism
+		return PokerEvalAPI.getSuitIsomorphism != 0
+	end
+
+	# The lookup table generated by the extension's build
+	EVAL_TABLE = File.dirname(__FILE__) + '/../ext/poker-eval-api/handval.tab'
+
+	# Maps a hand value lookup table read-only, so that processes loading the same file share it.
+	# The table built with the extension is loaded when this file is required.
+	#
+	# @param path [String] The table file
+	# @return [Boolean] Whether the table was loaded; a file that doesn't agree with the evaluator is refused
+	def self.load_eval_table(path = EVAL_TABLE)
+		return PokerEvalAPI.evalTableLoad(path) != 0
+	end
+
+	# Turns the lookup table evaluator in handStrength, handPotential and scoreTwoCards on or off.
+	# It is on by default once a table is loaded, and gives the same hand values as poker-eval.
+	# Setting the POKEREVAL_TABLE_EVAL environment variable to 0 turns it off initially.
+	#
+	# @param on [Boolean]
+	def self.table_eval=(on)
+		PokerEvalAPI.setTableEval(on ? 1 : 0)
+	end
+
+	# @return [Boolean] Whether the enumerations evaluate hands through a lookup table
+	def self.table_eval
+		return PokerEvalAPI.getTableEval != 0 && PokerEvalAPI.evalTableLoaded != 0
+	end
+
+	# Turns the SIMD evaluator, which scores eight hands at once, on or off. It is used for
+	# handPotential's runouts and for eval_batch, when no lookup table is in use, and gives
+	# the same hand values as poker-eval. Setting the POKEREVAL_SIMD_EVAL environment variable
+	# to 0 turns it off initially.
+	#
+	# @param on [Boolean]
+	def self.simd_eval=(on)
+		PokerEvalAPI.setSimdEval(on ? 1 : 0)
+	end
+
+	# @return [Boolean] Whether the SIMD evaluator is on
+	def self.simd_eval
+		return PokerEvalAPI.getSimdEval != 0
+	end
+
+	# Sizes the in-process cache of handStrength and handPotential results, which also serves
+	# #effective_hand_strength. Spots are keyed up to relabelling suits, so "AhKd" on "7c5s2h"
+	# and "AsKc" on "7h5d2s" share an entry. It is off (0) by default; the POKEREVAL_SPOT_CACHE
+	# environment variable sets the initial size. Resizing drops the cached results, and must not
+	# be done while other threads are evaluating.
+	#
+	# @param entries [Integer] The number of results to hold at least, or 0 to turn it off
+	def self.spot_cache_size=(entries)
+		PokerEvalAPI.spotCacheSetSize(entries)
+	end
+
+	# @return [Integer] The number of results the in-process cache holds
+	def self.spot_cache_size
+		return PokerEvalAPI.spotCacheSize
+	end
+
+	# Maps a spot cache file shared, as a second tier behind the in-process one, so that processes
+	# forked after opening it, or opening the same file, share their results. The file is created
+	# to hold the given number of entries if it doesn't exist.
+	#
+	# @param path [String] The cache file
+	# @param entries [Integer] (default: 1048576) The number of results a new file holds
+	# @return [Boolean] Whether the file was mapped
+	def self.open_spot_cache(path, entries = 1 << 20)
+		return PokerEvalAPI.spotCacheOpen(path, entries) != 0
+	end
+
+	# Unmaps the shared spot cache file, which keeps its results
+	def self.close_spot_cache
+		PokerEvalAPI.spotCacheClose
+	end
+
+	# Empties the spot cache, the shared file included
+	def self.clear_spot_cache
+		PokerEvalAPI.spotCacheClear
+	end
+
+	# @param reset [Boolean] (default: false) Zero the counters after reading them
+	# @return [Hash] The spot cache's hits (in process and shared), misses, inserts and evictions since
+	#   the last reset, and the size and number of used entries of each tier
+	def self.spot_cache_stats(reset = false)
+		stats = PokerEvalAPI.spotCacheStats
+		PokerEvalAPI.spotCacheResetStats if reset
+		return stats.members.map {|m| [m, stats[m]] }.to_h
+	end
+
+	# Fills the spot cache with flop results: for the given hole cards on every flop, or for every
+	# hand on every flop when none are given (about 1.3 million spots, each of hand strength and
+	# potential). The cache must be on and large enough to hold them.
+	#
+	# @param pocket [String] (optional) The hole cards
+	# @param kinds [Array<Symbol>] (default: [:hs, :hp]) Which results to compute
+	# @return [Integer, nil] The number of results computed, or nil if the cache is off
+	def self.prewarm_spot_cache(pocket = nil, kinds = [:hs, :hp])
+		bits = 0
+		bits |= 1 << PokerEvalAPI::SPOT_HS if kinds.include?(:hs)
+		bits |= 1 << PokerEvalAPI::SPOT_HP if kinds.include?(:hp)
+		n = PokerEvalAPI.spotCachePrewarm(PokerEvalAPI.TextToPokerEval(pocket || ''), bits)
+		return n >= 0 ? n : nil
+	end
+
+	# Writes the hand strength features of every flop or turn spot, one per suit isomorphism class,
+	# to a flat binary file for offline clustering: a 24 byte header ("PEHSF001", the number of board
+	# cards and buckets as uint32, the number of spots as uint64), then a record per spot of the pocket
+	# and board cards_n (uint64), E[HS] and E[HS^2] (float) and the histogram (float per bucket), as
+	# from #hs_distribution. There are about 1.3 million flop spots and 14 million turn spots, spread
+	# over the worker pool.
+	#
+	# @param path [String] The file to write
+	# @param board_cards [Integer] (default: 3) 3 for flop spots or 4 for turn spots
+	# @param buckets [Integer] (default: 10) The number of histogram buckets
+	# @return [Integer, nil] The number of spots written, or nil if the file couldn't be written
+	def self.write_hs_features(path, board_cards = 3, buckets = 10)
+		n = PokerEvalAPI.hsFeaturesWrite(path, board_cards, buckets)
+		return n >= 0 ? n : nil
+	end
+
+	# The preflop equity table built by "make preflop" in the extension's directory
+	PREFLOP_TABLE = File.dirname(__FILE__) + '/../ext/poker-eval-api/preflop.tab'
+
+	RankChars = %w{2 3 4 5 6 7 8 9 T J Q K A}
+	SuitChars = %w{h d c s}
+
+	# Maps a preflop equity table read-only. With it loaded, #get_equity answers heads-up
+	# queries with no board exactly, without simulating, and #preflop_equity can be used.
+	# The table built with the extension is loaded when this file is required.
+	#
+	# @param path [String] The table file
+	# @return [Boolean] Whether the table was loaded
+	def self.load_preflop_table(path = PREFLOP_TABLE)
+		@hand_groups = nil
+		return PokerEvalAPI.preflopTableLoad(path) != 0
+	end
+
+	# @return [Boolean] Whether a preflop equity table is loaded
+	def self.preflop_table
+		return PokerEvalAPI.preflopTableLoaded != 0
+	end
+
+	# Returns the abbreviation of one of the 169 preflop hand classes, eg. AA, AKs or AKo
+	#
+	# @param index [Integer] The class index, as returned by PokerEvalAPI.preflopClass
+	# @return [String] The abbreviation
+	def self.preflop_class_name(index)
+		hi, lo = index.divmod(13)
+		return RankChars[hi] * 2 if hi == lo
+		return RankChars[hi] + RankChars[lo] + 's' if hi > lo
+		return RankChars[lo] + RankChars[hi] + 'o'
+	end
+
+	# Returns the hand groups used by #hand_to_sklansky_group. With a preflop table loaded, the
+	# 169 hand classes are ranked by their equity against a random hand and split into groups
+	# of the same sizes as HandGroups; otherwise HandGroups itself.
+	#
+	# @return [Hash] The hands in each group, best group first
+	def self.hand_groups
+		return HandGroups unless preflop_table
+		@hand_groups ||= begin
+			ranked = (0...169).sort_by {|c| [-PokerEvalAPI.preflopClassEquityVsRandom(c), c] }
+			groups = {}
+			HandGroups.each do |group, hands|
+				groups[group] = ranked.shift(hands.length).map {|c| preflop_class_name(c) }
+			end
+			groups
+		end
+	end
+
+	# @return [String] The instruction set the SIMD evaluator was built for and picked at run
+	#   time: "avx2", "sse4.2" or "generic", or "scalar" when it is off
+	def self.simd_eval_path
+		return PokerEvalAPI.simdEvalPath
+	end
+
 	# Scores a single hand, passed by string
 	#
 	# @param hand [String] The player's pocket cards
 	# @param board [String] The board cards
 	# @return [Integer] The score of the hand
 	def score_hand(hand, board)
-		return PokerEvalAPI.Eval_Str_N(hand + board)
+		return PokerEvalAPI.Eval_Mask_N(join_cards(hand, board))
+	end
+
+	# Scores several hands against the same board, in a single native call
+	#
+	# @param hands [Array] The players' pocket cards, as strings
+	# @param board [String] The board cards
+	# @return [Array] The score of each hand
+	def score_hands(hands, board = '')
+		bcards = get_cards(board).cards_n
+		masks = hands.map {|hand| get_cards(hand).cards_n | bcards }
+		return PokerEvalAPI.eval_batch(masks)
 	end
 
 	# Classifies the hand (one pair, two pair, flush etc.)
@@ -162,7 +738,7 @@ class PokerEval
 	# @param board [String] The board cards
 	# @return [String] A string representing the hand type
 	def type_hand(hand, board)
-		type = PokerEvalAPI.Eval_Str_Type(hand + board)
+		type = PokerEvalAPI.Eval_Mask_Type(join_cards(hand, board))
 		return HandTypes[type]
 	end
 
@@ -173,8 +749,9 @@ class PokerEval
 	# @param board [String] The board cards
 	# @return [Integer] 1 if p1 wins, -1 if p2 wins, 0 of they are equal
 	def compare_hands(p1,p2,board)
-		p1score = PokerEvalAPI.Eval_Str_N(p1 + board)
-		p2score = PokerEvalAPI.Eval_Str_N(p2 + board)
+		bcards = get_cards(board)
+		p1score = PokerEvalAPI.Eval_Mask_N(join_cards(p1, bcards))
+		p2score = PokerEvalAPI.Eval_Mask_N(join_cards(p2, bcards))
 		return -1 if p1score < p2score
 		return 0 if p1score == p2score
 		return 1 if p1score > p2score
@@ -219,81 +796,322 @@ class PokerEval
 		return hs(get_cards(pocket), get_cards(board))
 	end
 
-	# Returns the hand strength using Ruby
+	# Converts a weight table keyed by cards_n (see #get_weight_from_table) into a dense
+	# weight vector with one float per two-card hand. Hands missing from the table get a weight of 1.
+	# The vector can be built once and passed to #hand_strength on every call.
+	#
+	# @param weight_table [Hash] Weights keyed by the cards_n of each pair of opponent's cards
+	# @return [FFI::MemoryPointer]
+	def weight_vector(weight_table)
+		weights = Array.new(PokerEvalAPI::N_COMBOS, 1.0)
+		weight_table.each do |cards_n, w|
+			idx = PokerEvalAPI.combo_indices[cards_n]
+			weights[idx] = w.to_f if idx
+		end
+		vector = FFI::MemoryPointer.new(:float, PokerEvalAPI::N_COMBOS)
+		vector.write_array_of_float(weights)
+		return vector
+	end
+
+	# Builds a weight vector for #range_equity. Unlike #weight_vector, hands that aren't listed get no weight
+	#
+	# @param range [Hash, Array, String, nil] A Hash mapping hands (as strings such as "AsKd" or raw cards_n
+	#   integers) to weights, an Array of hands each weighted 1, range notation as taken by #parse_range,
+	#   or nil for every hand
+	# @return [FFI::MemoryPointer] The weight vector
+	def range_vector(range)
+		return parse_range(range) if range.is_a?(String)
+		weights = Array.new(PokerEvalAPI::N_COMBOS, range.nil? ? 1.0 : 0.0)
+		pairs = range.is_a?(Hash) ? range : (range || []).map {|hand| [hand, 1.0] }
+		pairs.each do |hand, w|
+			cards_n = hand.is_a?(Integer) ? hand : get_cards(hand).cards_n
+			idx = PokerEvalAPI.combo_indices[cards_n]
+			weights[idx] = w.to_f if idx
+		end
+		vector = FFI::MemoryPointer.new(:float, PokerEvalAPI::N_COMBOS)
+		vector.write_array_of_float(weights)
+		return vector
+	end
+
+	# Compiles range notation into a weight vector, natively. Items are separated by commas or spaces:
+	# pairs ("QQ", "QQ+", "QQ-88"), suited, offsuit or both ("AQs", "AQo", "AQ"), kickers up to one
+	# below the top card ("AQs+"), spans of kickers or connectors ("A5s-A2s", "76s-54s") and single
+	# hands ("AsKd"). Any item may end in ":weight", and later items override earlier ones. Compiled
+	# ranges are cached by their text, so parsing the same range again is cheap.
+	#
+	# @param range [String] The range, eg. "TT+, AQs+, KJo, 76s-54s:0.5"
+	# @param dead [String, PokerEvalAPI::CardMask] (default: '') Cards no hand in the range may hold, such as the board
+	# @return [FFI::MemoryPointer] The weight vector, for #range_equity or #hand_strength
+	# @raise [ArgumentError] If an item can't be parsed
+	def parse_range(range, dead = '')
+		vector = FFI::MemoryPointer.new(:float, PokerEvalAPI::N_COMBOS)
+		res = PokerEvalAPI.rangeParse(range, get_cards(dead), vector)
+		if res < 0
+			item = range[(-1 - res)..-1][/\A[^,\s]+/]
+			raise ArgumentError, "#{item.inspect} is not a valid range item in #{range.inspect}"
+		end
+		return vector
+	end
+
+	# Expands range notation into the hands it holds
+	#
+	# @param range [String, FFI::Pointer] The range, as taken by #parse_range, or a weight vector
+	# @param dead [String, PokerEvalAPI::CardMask] (default: '') Cards no hand in the range may hold
+	# @return [Hash] The weight of each hand with any, keyed by cards_n
+	def range_combos(range, dead = '')
+		vector = range.is_a?(FFI::Pointer) ? range : parse_range(range, dead)
+		masks = FFI::MemoryPointer.new(:uint64, PokerEvalAPI::N_COMBOS)
+		weights = FFI::MemoryPointer.new(:float, PokerEvalAPI::N_COMBOS)
+		n = PokerEvalAPI.rangeMasks(vector, masks, weights)
+		return Hash[masks.read_array_of_uint64(n).zip(weights.read_array_of_float(n))]
+	end
+
+	# Returns the equity of one weighted range against another, in one native call. Runouts are
+	# enumerated when there are few enough of them, and sampled otherwise (preflop, with wide ranges).
+	#
+	# @param hero [Hash, Array, String, FFI::Pointer, nil] The player's range, as taken by #range_vector, or a weight vector
+	# @param villain [Hash, Array, String, FFI::Pointer, nil] The opponent's range
+	# @param board [String] (default: '') The board cards
+	# @option options [Integer] :max_work (default: 16777216) Enumerate when (hero hands + villain hands) * runouts is at most this
+	# @option options [Integer] :samples (default: 2000) The number of runouts to sample otherwise
+	# @option options [Integer] :seed (optional) Seed for the sampling, for repeatable results
+	# @return [Hash] :equity of the whole range (nil if no hands can meet), :exact, the number of :runouts,
+	#   and the equity of each hero hand in :combos
+	def range_equity(hero, villain, board = '', options = {})
+		options = { max_work: 1 << 24, samples: 2000, seed: nil }.merge(options)
+		hvec = hero.is_a?(FFI::Pointer) ? hero : range_vector(hero)
+		vvec = villain.is_a?(FFI::Pointer) ? villain : range_vector(villain)
+		out = FFI::MemoryPointer.new(:double, PokerEvalAPI::N_COMBOS)
+		seed = options[:seed] || rand(2**64)
+
+		res = PokerEvalAPI.rangeEquity(hvec, vvec, get_cards(board), options[:max_work], options[:samples], seed, out)
+		combos = {}
+		out.read_array_of_double(PokerEvalAPI::N_COMBOS).each_with_index do |eq, idx|
+			combos[combo_names[idx]] = eq if eq >= 0
+		end
+		return {
+			equity: res[:equity] >= 0 ? res[:equity] : nil,
+			exact: res[:exact] != 0,
+			runouts: res[:runouts],
+			combos: combos
+		}
+	end
+
+	# The name of each two-card hand, by its position in a weight vector
+	def combo_names
+		@combo_names ||= begin
+			names = []
+			PokerEvalAPI.combo_indices.each {|cards_n, idx| names[idx] = mask_to_str(cards_n) }
+			names
+		end
+	end
+
+	# Returns the hand strength, optionally against a weighted range of opponent's cards.
+	# Against 2 to 4 unweighted opponents it is exact, with split pots shared out; otherwise
+	# it is the strength against one opponent raised to the number of opponents
 	#
 	# @param pocket [String] The player's pocket cards
 	# @param board [String] The board cards
 	# @param opponents [Integer] (default: 1) The number of opponents
-	#	@param weight_table [Hash] (default: {}) A weight table to adjust the score given to each pair of opponent's cards.
+	#	@param weight_table [Hash, FFI::Pointer, String] (default: {}) A weight table to adjust the score given to each pair of opponent's cards,
+	#		a weight vector from #weight_vector or #parse_range, or range notation for the opponent's hands
 	def hand_strength(pocket, board, opponents = 1, weight_table = {})
-		ahead = tied = behind = 0
-		score = PokerEvalAPI.Eval_Str_N(pocket + board)
-		weighted_proc = Proc.new do |i, cards|
-			w = get_weight_from_table(cards, weight_table)
-			ahead += w if score > i
-			tied += w if score == i
-			behind += w if score < i
-		end
-		normal_proc =  Proc.new do |i, cards|
-			ahead += 1 if score > i
-			tied += 1 if score == i
-			behind += 1 if score < i
-		end
-		cb = weight_table.empty? ? normal_proc : weighted_proc
-		PokerEvalAPI.scoreTwoCards(pocket, board, cb)
-		handstrength = (ahead+tied/2.0) / (ahead+tied+behind)
+		pcards = get_cards(pocket)
+		bcards = get_cards(board)
+		if opponents > 1 && opponents <= PokerEvalAPI::MW_MAX_OPPONENTS && weight_table.is_a?(Hash) && weight_table.empty?
+			res = PokerEvalAPI.multiwayEquity(pcards, bcards, opponents, 0)
+			return res[:equity] if res[:equity] >= 0
+		end
+		weight_table = parse_range(weight_table, bcards) if weight_table.is_a?(String)
+		if weight_table.is_a?(FFI::Pointer)
+			handstrength = PokerEvalAPI.handStrengthWeighted(pcards, bcards, weight_table)
+		elsif weight_table.empty?
+			handstrength = PokerEvalAPI.handStrength(pcards, bcards)
+		else
+			handstrength = PokerEvalAPI.handStrengthWeighted(pcards, bcards, weight_vector(weight_table))
+		end
 		return handstrength ** opponents
 	end
 
-	# Does a montecarlo simulation to estimate the strength of a given hand
+	# Returns the exact all-in equity against 1 to 4 random hands, with the board dealt out to the river.
+	# Every deal of the opponents' hands and the rest of the board is counted, and split pots are
+	# shared between all the players in them
+	#
+	# @param pocket [String] The player's hole cards
+	# @param board [String] The board cards, the flop at least
+	# @param opponents [Integer] (default: 1) The number of opponents
+	# @param to_river [Boolean] (default: true) Deal the board out, or compare hands on the board as it is
+	# @return [Hash, nil] The fractions of deals won outright (:win), split (:tie) and lost (:lose), and
+	#   the :equity, or nil for an unsupported spot
+	def multiway_equity(pocket, board, opponents = 1, to_river = true)
+		res = PokerEvalAPI.multiwayEquity(get_cards(pocket), get_cards(board), opponents, to_river ? 1 : 0)
+		return nil if res[:equity] < 0
+		return { win: res[:win], tie: res[:tie], lose: res[:lose], equity: res[:equity] }
+	end
+
+	# Starts #multiway_equity in the background
+	#
+	# @return [Job, nil] The job, whose value is the hash #multiway_equity returns, or nil for an
+	#   unsupported spot
+	def multiway_equity_async(pocket, board, opponents = 1, to_river = true)
+		ptr = PokerEvalAPI.multiwayEquityJob(get_cards(pocket), get_cards(board), opponents, to_river ? 1 : 0)
+		return nil if ptr.null?
+		return Job.new(ptr) {|r| { win: r[0], tie: r[1], lose: r[2], equity: r[3] } }
+	end
+
+	# Returns the distribution of hand strength over every way of dealing the board out to the river,
+	# in one native call. Hand strength on each river is against one random hand, as from #hand_strength.
+	#
+	# @param pocket [String] The player's hole cards
+	# @param board [String] The board cards, 3 to 5 of them
+	# @param buckets [Integer] (default: 10) The number of equal width buckets in the histogram
+	# @return [Hash, nil] :ehs and :ehs2 (E[HS] and E[HS^2]), the fraction of rivers in each bucket
+	#   as :histogram and the number of :runouts, or nil for an unsupported spot
+	def hs_distribution(pocket, board, buckets = 10)
+		return nil if buckets < 1
+		hist = FFI::MemoryPointer.new(:double, buckets)
+		res = PokerEvalAPI.hsDistribution(get_cards(pocket), get_cards(board), buckets, hist)
+		return nil if res[:runouts] < 0
+		return { ehs: res[:ehs], ehs2: res[:ehs2], histogram: hist.read_array_of_double(buckets), runouts: res[:runouts] }
+	end
+
+	# Returns the extension's instrumentation counters, summed over all threads since the last reset:
+	# for each entry point (:hand_strength, :hand_potential, :score_two_cards, :eval_outs and :parse
+	# for card strings) the calls, hand evaluations, combinations covered, and the time spent in it
+	# (:ns and :cycles) and in callbacks (:callback_ns). The counters are only compiled in when the
+	# extension is built with --enable-stats.
+	#
+	# @param reset [Boolean] (default: false) Start counting again from zero after reading them
+	# @return [Hash, nil] The counters by entry point, or nil if they aren't compiled in
+	def stats(reset = false)
+		n = PokerEvalAPI::STAT_ENTRIES.length
+		buf = FFI::MemoryPointer.new(PokerEvalAPI::EvalStatCounters, n)
+		on = PokerEvalAPI.evalStatsRead(buf) != 0
+		PokerEvalAPI.evalStatsReset if reset && on
+		return nil unless on
+		return PokerEvalAPI::STAT_ENTRIES.each_with_index.map do |entry, i|
+			counters = PokerEvalAPI::EvalStatCounters.new(buf + i * PokerEvalAPI::EvalStatCounters.size)
+			[entry, counters.members.map {|m| [m, counters[m]] }.to_h]
+		end.to_h
+	end
+
+	# Scores every opponent hand on the board, in one native call that releases the GVL
+	#
+	# @param pocket [String] The player's hole cards, which no opponent can hold
+	# @param board [String] The board cards
+	# @return [Hash] The score of each opponent hand with the board, by hand
+	def opponent_scores(pocket, board)
+		out = FFI::MemoryPointer.new(:uint32, PokerEvalAPI::N_COMBOS)
+		PokerEvalAPI.scoreTwoCardsInto(get_cards(pocket), get_cards(board), out)
+		scores = {}
+		out.read_array_of_uint32(PokerEvalAPI::N_COMBOS).each_with_index do |score, idx|
+			scores[combo_names[idx]] = score if score > 0
+		end
+		return scores
+	end
+
+	# Returns the exact all-in equity of hole cards before the flop, from the preflop table
+	#
+	# @param pocket [String] The player's hole cards
+	# @param opponent [String] (optional) The opponent's hole cards. Against a random hand if not given
+	# @return [Float, nil] The equity, or nil if no preflop table is loaded or the hands share a card
+	def preflop_equity(pocket, opponent = nil)
+		pcards = get_cards(pocket)
+		equity = opponent ? PokerEvalAPI.preflopEquity(pcards, get_cards(opponent)) : PokerEvalAPI.preflopEquityVsRandom(pcards)
+		return equity >= 0 ? equity : nil
+	end
+
+	# Does a montecarlo simulation to estimate the strength of a given hand.
+	# With no board and one opponent, the exact equity is looked up instead when a preflop
+	# table is loaded, unless the sampling is asked for with :iterations, :seed, :target_se
+	# or :deadline. From the flop on, #multiway_equity gives it exactly.
+	# Given a :target_se or a :deadline, it samples until either is met, as #equity_estimate does
 	#	
 	# @option options [String] :pocket The player's hole cards
 	# @option options [String] :board The board cards
 	# @option options [Integer] :iterations The number of montecarlo simulations
 	# @option options [Integer] :num_opponents The number of opponent hands to simulate
+	# @option options [Integer] :seed (optional) Seed for the simulation's random number generator, for repeatable results
+	# @option options [Float] :target_se (optional) Sample until the standard error is this small
+	# @option options [Float] :deadline (optional) Sample for at most this many seconds
 	# @return [Float] The percentage of times the player's hand wins
 	def get_equity(options = {})
 		defaults = {
 			pocket: '',
 			board: '',
 			iterations: 500,
-			num_opponents: 1
+			num_opponents: 1,
+			seed: nil
 		}
 
+		sampling = [:iterations, :seed, :target_se, :deadline].any? {|k| options.key?(k) }
 		options = defaults.merge(options)
 
-		pocket = options[:pocket]
-		board = options[:board]
-		num_opponents = options[:num_opponents]
-		num_iter = options[:iterations]
+		pcards = get_cards(options[:pocket])
+		bcards = get_cards(options[:board])
+		seed = options[:seed] || rand(2**64)
 
-		pcards = get_cards(pocket)
-		bcards = get_cards(board)
-		dead = new_cards
-		dead << pcards
-		dead << bcards
-		player_sizes = [2] * num_opponents
-		player_sizes << 5 - bcards.count
-
-		ahead = tied = behind = 0
-
-		montecarlo_sets(player_sizes, dead, num_iter) do |sets|
-			board = sets.pop
-			ours = dead.clone
-			ours << board
-			ourscore = ours.eval(7)
-			
-			oppscores = sets.map {|cards| cards << board; cards.eval(7)}
-			score = oppscores.max
-			ahead += 1 if ourscore > score
-			tied += 1 if ourscore == score
-			behind += 1 if ourscore < score
+		if !sampling && bcards.count == 0 && options[:num_opponents] == 1 && PokerEval.preflop_table
+			equity = PokerEvalAPI.preflopEquityVsRandom(pcards)
+			return equity if equity >= 0
+		end
+
+		if options[:target_se] || options[:deadline]
+			return equity_estimate(options)[:equity]
 		end
 
+		tally = PokerEvalAPI.monteCarloEquity(pcards, bcards, options[:num_opponents], options[:iterations], seed)
+		ahead = tally[:ahead]
+		tied = tally[:tied]
+		behind = tally[:behind]
+
 		equity = (ahead+tied/2.0) / (ahead+tied+behind)
 		return equity
 	end
 
+	# Estimates the equity of a hand against random hands by sampling until the estimate is good
+	# enough, rather than for a fixed number of iterations. Sampling stops once the standard error
+	# is at most :target_se, after :deadline seconds, or after :max_samples deals, whichever is first.
+	# Stratified sampling deals the next card from every live card in turn, which takes out
+	# the variance it would add
+	#
+	# @option options [String] :pocket The player's hole cards
+	# @option options [String] :board The board cards
+	# @option options [Integer] :num_opponents (default: 1) The number of opponent hands
+	# @option options [Float] :target_se (default: 0.005) The standard error to stop at, or nil
+	# @option options [Float] :deadline (optional) The most seconds to sample for
+	# @option options [Integer] :max_samples (default: 1000000) The most deals to sample
+	# @option options [Boolean] :stratified (default: false) Stratify the deals by their first card;
+	#   sampling is plain if :max_samples is less than the number of live cards
+	# @option options [Integer] :seed (optional) Seed for the sampling, for repeatable results
+	# @return [Hash, nil] The :equity, its :std_error, the 95% :interval and the number of :samples,
+	#   or nil if the hands can't be dealt
+	def equity_estimate(options = {})
+		options = {
+			pocket: '',
+			board: '',
+			num_opponents: 1,
+			target_se: 0.005,
+			deadline: nil,
+			max_samples: 1_000_000,
+			stratified: false,
+			seed: nil
+		}.merge(options)
+		seed = options[:seed] || rand(2**64)
+		deadline_ms = options[:deadline] ? options[:deadline] * 1000.0 : 0
+
+		est = PokerEvalAPI.monteCarloEquityAdaptive(get_cards(options[:pocket]), get_cards(options[:board]),
+			options[:num_opponents], options[:target_se] || 0, deadline_ms, options[:max_samples],
+			options[:stratified] ? 1 : 0, seed)
+		return nil if est[:equity] < 0
+		return {
+			equity: est[:equity],
+			std_error: est[:std_error],
+			interval: [est[:low], est[:high]],
+			samples: est[:samples]
+		}
+	end
+
 	def mc_hand_potential(ours, board, num_iter = 100)
 		set_sizes = [2,1]
 		dead = ours.clone
@@ -356,7 +1174,8 @@ class PokerEval
 	# @param maxcards [Integer] The maximum number of cards to score (7 is 2-card lookahead, 6 is 1-card)
 	# @return [Array] 
 	def hand_potential(pocket, board, maxcards = 6)
-		cards = board.length / 2
+		bcards = get_cards(board)
+		cards = bcards.count
 		if (cards == 5)
 			return [0,0]
 		elsif cards == 4
@@ -364,20 +1183,32 @@ class PokerEval
 		else
 			maxcards = 6
 		end
-		hpot = PokerEvalAPI.handPotential(pocket, board, maxcards)
+		hpot = PokerEvalAPI.handPotentialMask(get_cards(pocket), bcards, maxcards)
     ppot = hpot[:ppot].nan? ? 1.0 : hpot[:ppot]
     npot = hpot[:npot].nan? ? 1.0 : hpot[:npot]
 		return [ppot, npot]
 	end
 
+	# Starts #hand_potential in the background. As there, the flop looks one card ahead and the
+	# turn two, and the river's job is done at once with a value of [0, 0].
+	#
+	# @param maxcards [Integer] (default: 6) Ignored, as for #hand_potential
+	# @return [Job, nil] The job, whose value is [ppot, npot], or nil for an unsupported spot
+	def hand_potential_async(pocket, board, maxcards = 6)
+		bcards = get_cards(board)
+		maxcards = bcards.count == 4 ? 7 : 6
+		ptr = PokerEvalAPI.handPotentialJob(get_cards(pocket), bcards, maxcards)
+		return nil if ptr.null?
+		return Job.new(ptr) {|r| r[0, 2].map {|p| p.nan? ? 1.0 : p } }
+	end
+
 	# @param pocket [String] Hole cards
 	# @param board [String] Board cards
 	# @return [Hash] Probability of hitting each type of hand
 	# @example
 	#		outs = pe.eval_outs("7s7c", "8h9dJs")
 	def eval_outs(pocket, board)
-		psize = pocket.length / 2
-		bsize = board.length / 2
+		bsize = get_cards(board).count
 
 		stages = {
 			'3' => "Flop",
@@ -387,36 +1218,22 @@ class PokerEval
 
 		r_stages = {}
 
+		# one native enumeration counts the hand types on every later street
+		res = PokerEvalAPI.evalOutsAll(get_cards(pocket), get_cards(board))
+		counts = res[:counts].to_a
+
 		# 3..5 = for flop, turn, river
 		(3..5).each do |tot|
 			next if tot <= bsize
 			stage = stages[tot.to_s]
-
-			results = []
-
-			# simple callback to fetch results for each iteration
-			cb = Proc.new do |i,cards|
-				results.push(i)
-			end
-
-			# run the eval
-			PokerEvalAPI.evalOuts(pocket, psize, board, bsize, tot, cb)
-
-			stats = []
-
-			# collect stats for each type of hand
-			results.each do |e|
-				stats[e] = (stats[e] || 0) + 1
-			end
-
-			# get sum
-			total = stats.inject(0) {|sum, n| sum += (n || 0)}
+			street = tot - 3
+			total = res[:totals][street]
 
 			stats_name = {}
 
 			# get percentages
 			(0..8).each do |i|
-				pct = (((stats[i] || 0) / total.to_f) * 100)
+				pct = ((counts[street * 9 + i] / total.to_f) * 100)
 				stats_name[HandTypes[i]] = pct
 			end
 			
@@ -428,20 +1245,28 @@ class PokerEval
 		return r_stages
 	end
 
+	# Returns the cards that would improve the type of the current hand if they came next
+	#
+	# @param pocket [String] Hole cards
+	# @param board [String] Board cards (flop or turn)
+	# @return [String] The improving cards, eg. "TsTcTdTh"
+	# @example
+	#		pe.outs("7s7c", "8h9dJs")
+	def outs(pocket, board)
+		res = PokerEvalAPI.evalOutsAll(get_cards(pocket), get_cards(board))
+		return res[:outs].to_s
+	end
+
 	# Returns a random card (as a PokerEvalAPI::CardMask)
 	def random_card
 		return PokerEvalAPI.wrap_StdDeck_MASK(rand(52))
 	end
 
-	#	Performs a montecarlo simulation, yielding the generated cards
-	def montecarlo(dead, num_cards, num_iter)
-		num_iter.times do
-			cards = new_cards
-			used = dead.clone
-			num_cards.times do
-				add_random_card_not_in(cards, used)
-			end
-			yield cards
+	#	Performs a montecarlo simulation, yielding the generated cards. The cards are dealt natively,
+	# and unless fresh is set, the same CardMask is refilled every iteration; clone it to keep it.
+	def montecarlo(dead, num_cards, num_iter, fresh = false)
+		Deck.new(dead).each_deal([num_cards], num_iter, fresh) do |sets|
+			yield sets[0]
 		end
 	end
 
@@ -451,11 +1276,8 @@ class PokerEval
 	end
 
 	def get_random_cards_not_in_str(str, i = 2)
-		used = get_cards(str)
 		cards = new_cards
-		i.times do
-			add_random_card_not_in(cards, used)
-		end
+		cards[:cards_n] = deal_not_in(get_cards(str), i)
 		return cards.to_s
 	end
 
@@ -465,35 +1287,31 @@ class PokerEval
 
 	# Adds one random card that's not in the given set of used cards 
 	def add_random_card_not_in(cards, used)
-		loop do
-			card = random_card
-			unless used.any_set(card)
-				cards << card
-				used << card
-				break
-			end
-		end
+		card = new_cards
+		card[:cards_n] = deal_not_in(used, 1)
+		cards << card
+		used << card
+	end
+
+	# Deals n cards not in used, as a cards_n mask. Setting the dead cards and dealing go
+	# together, so each thread deals from a deck of its own.
+	def deal_not_in(used, n)
+		deck = (Thread.current[:pokereval_deck] ||= Deck.new)
+		deck.dead = used
+		return deck.deal([n])[0][0]
 	end
+	private :deal_not_in
 
 	# Deals random cards in the given sizes of sets, up to the requested number of iterations
-	# This can be used for Montecarlo simulations.
+	# This can be used for Montecarlo simulations. The cards are dealt natively, and unless fresh
+	# is set, the same CardMasks are refilled every iteration; clone any that are kept.
 	#
 	# @param set_sizes [Array] The number of cards in each set
 	# @param dead [PokerEvalAPI::CardMask] Cards to exclude from the selection
 	# @param num_iter [Integer] The number of iterations
-	def montecarlo_sets(set_sizes, dead, num_iter)
-		num_iter.times do
-			used = dead.clone
-			sets = []
-			set_sizes.each do |size|
-				set_cards = new_cards
-				size.times do
-					add_random_card_not_in(set_cards, used)
-				end
-				sets << set_cards
-			end
-			yield sets
-		end
+	# @param fresh [Boolean] (default: false) Yield new CardMasks every iteration
+	def montecarlo_sets(set_sizes, dead, num_iter, fresh = false, &block)
+		Deck.new(dead).each_deal(set_sizes, num_iter, fresh, &block)
 	end
 
 	# Returns an empty CardMask
@@ -502,14 +1320,44 @@ class PokerEval
 		return PokerEvalAPI::CardMask.new
 	end
 
-	# Returns a CardMask for the given string
+	# Returns a CardMask for the given string. A CardMask is returned as it is, so the methods that
+	# take cards as strings also take masks parsed once with #parse_cards.
 	#
-	# @param str [String] The string representing the cards, eg. AsAc
+	# @param str [String, PokerEvalAPI::CardMask] The string representing the cards, eg. AsAc
 	# @return [PokerEvalAPI::CardMask]
 	def get_cards(str)
+		return str if str.is_a?(PokerEvalAPI::CardMask)
 		return PokerEvalAPI.TextToPokerEval(str)
 	end
 
+	# Parses cards into a CardMask once, checking them, for reuse in loops that shouldn't
+	# parse text on every call. #get_cards skips whatever isn't a card.
+	#
+	# @param str [String] The cards, eg. "AsAc"; spaces between cards are allowed
+	# @return [PokerEvalAPI::CardMask]
+	# @raise [ArgumentError] If a token isn't a card, or a card appears twice
+	def parse_cards(str)
+		text = str.delete(' ')
+		raise ArgumentError, "odd number of characters in #{str.inspect}" if text.length.odd?
+		tokens = text.scan(/../)
+		indices = tokens.map do |token|
+			rank = RankChars.index(token[0].upcase)
+			suit = SuitChars.index(token[1].downcase)
+			raise ArgumentError, "#{token.inspect} is not a card in #{str.inspect}" unless rank && suit
+			suit * 13 + rank
+		end
+		dup = indices.detect {|i| indices.count(i) > 1 }
+		raise ArgumentError, "#{tokens[indices.index(dup)].inspect} appears twice in #{str.inspect}" if dup
+		return PokerEvalAPI.cards_to_mask(indices)
+	end
+
+	# The union of two sets of cards, as strings or masks, leaving both alone
+	def join_cards(a, b)
+		cards = new_cards
+		cards[:cards_n] = get_cards(a).cards_n | get_cards(b).cards_n
+		return cards
+	end
+
 	def mask_to_str(cards_n)
 		cm = PokerEvalAPI::CardMask.new
 		cm[:cards_n] = cards_n
@@ -562,7 +1410,7 @@ class PokerEval
 	# @return [Integer] The Sklansky group
 	def hand_to_sklansky_group(hand_str)
 		abbr = str_to_abbr(hand_str)
-		HandGroups.each do |group, hands|
+		PokerEval.hand_groups.each do |group, hands|
 			if hands.include?(abbr)
 				return group
 			end
@@ -571,3 +1419,10 @@ class PokerEval
 	end
 
 end
+
+PokerEval.threads = ENV['POKEREVAL_THREADS'].to_i if ENV['POKEREVAL_THREADS']
+PokerEval.spot_cache_size = ENV['POKEREVAL_SPOT_CACHE'].to_i if ENV['POKEREVAL_SPOT_CACHE']
+PokerEval.load_eval_table if File.exist?(PokerEval::EVAL_TABLE)
+PokerEval.load_preflop_table if File.exist?(PokerEval::PREFLOP_TABLE)
+PokerEval.table_eval = ENV['POKEREVAL_TABLE_EVAL'] != '0' if ENV['POKEREVAL_TABLE_EVAL']
+PokerEval.simd_eval = ENV['POKEREVAL_SIMD_EVAL'] != '0' if ENV['POKEREVAL_SIMD_EVAL']
@@ -38,6 +38,26 @@ describe PokerEval do
 		expect(cstr).to eq('AsJs')
 	end
 
+	it "Can parse cards once, checking them" do
+		cards = pe.parse_cards("As Jd 2h")
+		expect(cards.cards_n).to eq(pe.get_cards("AsJd2h").cards_n)
+		expect(cards.to_s).to eq("AsJd2h")
+		expect { pe.parse_cards("AsXx") }.to raise_error(ArgumentError)
+		expect { pe.parse_cards("AsAs") }.to raise_error(ArgumentError)
+		expect { pe.parse_cards("AsK") }.to raise_error(ArgumentError)
+		expect(PokerEvalAPI.cards_to_mask([51, 48]).to_s).to eq("AsJs")
+		expect { PokerEvalAPI.cards_to_mask([51, 51]) }.to raise_error(ArgumentError)
+		expect { PokerEvalAPI.cards_to_mask([52]) }.to raise_error(ArgumentError)
+
+		pocket = pe.parse_cards("AhKd")
+		board = pe.parse_cards("7c5s2h")
+		expect(pe.hand_strength(pocket, board)).to eq(pe.hand_strength("AhKd", "7c5s2h"))
+		expect(pe.hand_potential(pocket, board)).to eq(pe.hand_potential("AhKd", "7c5s2h"))
+		expect(pe.score_hand(pocket, board)).to eq(pe.score_hand("AhKd", "7c5s2h"))
+		expect(pe.type_hand(pocket, board)).to eq("NoPair")
+		expect(pocket.cards_n).to eq(pe.get_cards("AhKd").cards_n)
+	end
+
 	it "Can type hands" do
 		hand_type = pe.type_hand("2h3h", "4h5h6h")
 		expect(hand_type).to eq('StraightFlush')
@@ -57,6 +77,11 @@ describe PokerEval do
 		expect(hand_type).to eq('NoPair')
 	end
 
+	it "Can score hands in a batch" do
+		scores = pe.score_hands(["2h3h", "7s2d"], "4h5h6h")
+		expect(scores).to eq([pe.score_hand("2h3h", "4h5h6h"), pe.score_hand("7s2d", "4h5h6h")])
+	end
+
 	it "Can compare hands" do
 		cmp = pe.compare_hands("2h3h", "7s2d", "4h5h6h")
 		expect(cmp).to eq(1)
@@ -75,12 +100,279 @@ describe PokerEval do
 		expect(hs_from_ruby).to eq(hs)
 	end
 
+	it "Can get weighted HS" do
+		hs = pe.str_to_hs("7s2d", "5s9d8c")
+		ones = {pe.get_cards("AhAc").cards_n => 1}
+		expect(pe.hand_strength("7s2d", "5s9d8c", 1, ones)).to eq(hs)
+
+		# Only 7x2x and worse are left in the range
+		weak = {}
+		PokerEvalAPI.combo_indices.each_key {|cards_n| weak[cards_n] = 0 }
+		weak[pe.get_cards("7h2h").cards_n] = 1
+		weak[pe.get_cards("6h2c").cards_n] = 3
+		vector = pe.weight_vector(weak)
+		expect(pe.hand_strength("7s2d", "5s9d8c", 1, vector)).to eq(0.875)
+		expect(pe.hand_strength("7s2d", "5s9d8c", 1, weak)).to eq(0.875)
+	end
+
 	it "Can get hand potentials" do
 		(ppot, npot) = pe.hand_potential("2h3h", "4h5h9c")
 		expect(ppot).to be > 0.3
 		(ppot, npot) = pe.hand_potential("Td5s", "4h5h9c")
 		expect(npot).to be > 0.1
 	end
+
+	it "Gets identical results from the worker pool" do
+		serial = [pe.hand_potential("2h3h", "4h5h9c"), pe.str_to_hs("Td5s", "4h5h9c"), pe.hand_strength("Td5s", "4h5h9c")]
+		PokerEval.threads = 4
+		expect(PokerEval.threads).to eq(4)
+		parallel = [pe.hand_potential("2h3h", "4h5h9c"), pe.str_to_hs("Td5s", "4h5h9c"), pe.hand_strength("Td5s", "4h5h9c")]
+		PokerEval.threads = 1
+		expect(parallel).to eq(serial)
+	end
+
+	it "Gets identical results with suit isomorphism" do
+		spots = [["AsKs", "7s5s2s"], ["QdQc", "2h3h4h"], ["Td5s", "4h5h9cKd"]]
+		iso = spots.map { |p, b| [pe.hand_potential(p, b), pe.hand_strength(p, b)] }
+		PokerEval.suit_isomorphism = false
+		expect(PokerEval.suit_isomorphism).to eq(false)
+		plain = spots.map { |p, b| [pe.hand_potential(p, b), pe.hand_strength(p, b)] }
+		PokerEval.suit_isomorphism = true
+		expect(iso).to eq(plain)
+	end
+
+	it "Gets identical results from the lookup table evaluator" do
+		skip "no lookup table built" unless PokerEval.table_eval
+		spots = [["AsKs", "7s5s2s"], ["Td5s", "4h5h9c"], ["9h8h", "7c6d2sQh"]]
+		results = lambda do
+			spots.map do |p, b|
+				scores = []
+				PokerEvalAPI.scoreTwoCards(p, b, Proc.new {|score, cards| scores << score })
+				[pe.hand_potential(p, b), pe.hand_strength(p, b), scores]
+			end
+		end
+		table = results.call
+		PokerEval.table_eval = false
+		expect(PokerEval.table_eval).to eq(false)
+		plain = results.call
+		PokerEval.table_eval = true
+		expect(table).to eq(plain)
+	end
+
+	it "Gets identical results from the SIMD evaluator" do
+		hands = %w{9s9d9h4d4cAh2c AsKsQsJsTs9s8s 2c7d9hJsKd3h4s 5h5d5c5s2h2dAc
+			Tc9c8c7c6cAhAd 3h4h5h6h8dKsQs AhAd2c2d3h3s9c Jd8d4d2dKcKh7s}.map {|h| PokerEvalAPI.TextToPokerEval(h) }
+		table = PokerEval.table_eval
+		PokerEval.table_eval = false
+		results = lambda do
+			[pe.hand_potential("9h8h", "7c6d2s"), PokerEvalAPI.eval_batch(hands), PokerEvalAPI.eval_type_batch(hands)]
+		end
+		simd = results.call
+		PokerEval.simd_eval = false
+		expect(PokerEval.simd_eval_path).to eq("scalar")
+		plain = results.call
+		PokerEval.simd_eval = true
+		PokerEval.table_eval = table
+		expect(simd).to eq(plain)
+		expect(simd[1]).to eq(hands.map {|h| h.eval(7) })
+	end
+
+	it "Gets identical results from the spot cache" do
+		spots = [["AhKd", "7c5s2h"], ["AsKc", "7h5d2s"], ["9h8h", "Th7hJc"], ["QdJd", "Ts9s2c8h"]]
+		results = lambda { spots.map {|p, b| [pe.hand_strength(p, b), pe.hand_potential(p, b)] } }
+		plain = results.call
+		PokerEval.spot_cache_size = 1024
+		PokerEval.spot_cache_stats(true)
+		cold = results.call
+		warm = results.call
+		stats = PokerEval.spot_cache_stats
+		PokerEval.spot_cache_size = 0
+		expect(cold).to eq(plain)
+		expect(warm).to eq(plain)
+		# the second spot is the first with its suits relabelled
+		expect(stats[:misses]).to eq(6)
+		expect(stats[:hits]).to eq(10)
+		expect(stats[:used]).to eq(6)
+	end
+
+	it "Can evaluate from several threads at once" do
+		spots = [["AhKd", "7c5s2h"], ["9h8h", "Th7hJc"], ["QdJd", "Ts9s2c8h"], ["2c2d", "AsKsQh"]]
+		serial = spots.map {|p, b| [pe.hand_strength(p, b), pe.hand_potential(p, b), pe.get_cards(p + b).to_s] }
+		threads = spots.map {|p, b| Thread.new { [pe.hand_strength(p, b), pe.hand_potential(p, b), pe.get_cards(p + b).to_s] } }
+		expect(threads.map(&:value)).to eq(serial)
+
+		scores = pe.opponent_scores("AhKd", "7c5s2hQs")
+		expect(scores.length).to eq(1035)
+		expect(scores["KsKc"]).to eq(pe.get_cards("KsKc7c5s2hQs").eval(6))
+		ptr = PokerEvalAPI.text_to_ptr("AsKs")
+		expect(PokerEvalAPI::CardMask.new(ptr).to_s).to eq("AsKs")
+	end
+
+	it "Can count evaluations when built with stats" do
+		skip "the extension was built without --enable-stats" unless pe.stats(true)
+		pe.hand_strength("AhKd", "7c5s2h")
+		pe.opponent_scores("AhKd", "7c5s2h")
+		stats = pe.stats
+		expect(stats[:hand_strength][:calls]).to eq(1)
+		expect(stats[:hand_strength][:combos]).to eq(1081)
+		expect(stats[:score_two_cards][:evals]).to eq(1081)
+		expect(stats[:parse][:calls]).to be >= 2
+		expect(stats[:eval_outs][:calls]).to eq(0)
+		pe.stats(true)
+		expect(pe.stats[:hand_strength][:calls]).to eq(0)
+	end
+
+	it "Can look up preflop equity" do
+		skip "no preflop table built" unless PokerEval.preflop_table
+		expect(pe.preflop_equity("AsAh", "KdKc")).to be_within(0.005).of(0.82)
+		expect(pe.preflop_equity("AsAh", "KdKc") + pe.preflop_equity("KdKc", "AsAh")).to be_within(1e-12).of(1)
+		expect(pe.preflop_equity("AsAh", "AsKd")).to be_nil
+		expect(pe.get_equity(pocket: "AsKs")).to eq(pe.preflop_equity("AhKh"))
+		expect(pe.get_equity(pocket: "AsKs", iterations: 1000, seed: 1)).not_to eq(pe.preflop_equity("AhKh"))
+		expect(PokerEval.hand_groups[1]).to include("AA")
+		expect(pe.hand_to_sklansky_group("2c7d")).to eq(8)
+	end
+
+	it "Can get range against range equity" do
+		res = pe.range_equity(["AhKd"], nil, "7c5s2hKcQd")
+		expect(res[:exact]).to eq(true)
+		expect(res[:runouts]).to eq(1)
+		expect(res[:equity]).to be_within(1e-9).of(pe.hand_strength("AhKd", "7c5s2hKcQd"))
+		expect(res[:combos].keys).to eq(["AhKd"])
+
+		res = pe.range_equity({"AsAh" => 1, "KsKh" => 0.5}, %w{QsQh JsJh AdKd}, "7c5s2h")
+		expect(res[:exact]).to eq(true)
+		expect(res[:combos].length).to eq(2)
+		expect(res[:equity]).to be > 0.5
+		expect(pe.range_equity(["AsAh"], ["AsAd"], "7c5s2h")[:equity]).to be_nil
+
+		res = pe.range_equity(["AsAh"], ["KdKc"], "", samples: 20000, max_work: 0, seed: 1)
+		expect(res[:exact]).to eq(false)
+		expect(res[:runouts]).to eq(20000)
+		expect(res[:equity]).to be_within(0.02).of(0.8126)
+	end
+
+	it "Can parse hand ranges" do
+		expect(pe.range_combos("TT+").length).to eq(30)
+		expect(pe.range_combos("TT+, AQs+, KJo, 76s-54s").length).to eq(62)
+		expect(pe.range_combos("QQ-88 A5s-A2s").length).to eq(46)
+		expect(pe.range_combos("TT+", "AhKdTc").length).to eq(21)
+		combos = pe.range_combos("AA-22:0.5, AA")
+		expect(combos.length).to eq(78)
+		expect(combos[pe.get_cards("AsAh").cards_n]).to eq(1.0)
+		expect(combos[pe.get_cards("2s2h").cards_n]).to eq(0.5)
+		expect(pe.range_combos("AsKd")).to eq(pe.get_cards("AsKd").cards_n => 1.0)
+		expect { pe.parse_range("TT+, AQx") }.to raise_error(ArgumentError, /AQx/)
+		expect { pe.parse_range("76s-53s") }.to raise_error(ArgumentError)
+
+		range = {"AsAh" => 1, "KsKh" => 0.5}
+		expect(pe.range_equity("AsAh, KsKh:0.5", %w{QsQh JsJh AdKd}, "7c5s2h")[:equity]).to be_within(1e-12).of(pe.range_equity(range, %w{QsQh JsJh AdKd}, "7c5s2h")[:equity])
+		expect(pe.hand_strength("AhKd", "7c5s2h", 1, "QQ+, AK")).to be_within(1e-9).of(pe.hand_strength("AhKd", "7c5s2h", 1, pe.parse_range("QQ+, AK", "7c5s2h")))
+	end
+
+	it "Can get exact multiway equity" do
+		expect(pe.hand_strength("AhKd", "7c5s2hKcQd", 2)).to be_within(1e-9).of(0.811904202602)
+		expect(pe.hand_strength("2h3d", "AsKsQsJsTs", 3)).to be_within(1e-12).of(0.25)
+		res = pe.multiway_equity("AhKd", "7c5s2hKcQd", 1)
+		expect(res[:equity]).to be_within(1e-12).of(pe.hand_strength("AhKd", "7c5s2hKcQd"))
+		res = pe.multiway_equity("AhKd", "7c5s2h", 2)
+		expect(res[:win] + res[:tie] + res[:lose]).to be_within(1e-12).of(1)
+		expect(res[:equity]).to be_within(0.01).of(pe.get_equity(pocket: "AhKd", board: "7c5s2h", num_opponents: 2, iterations: 20000, seed: 1))
+		expect(pe.multiway_equity("AhKd", "", 2)).to be_nil
+		expect(pe.multiway_equity("AhKd", "7c5s2h", 5)).to be_nil
+	end
+
+	it "Can run hand potential and equity in the background" do
+		job = pe.hand_potential_async("2h3h", "4h5h9c")
+		expect(job.value).to eq(pe.hand_potential("2h3h", "4h5h9c"))
+		expect(job.progress).to eq(1)
+		job = pe.multiway_equity_async("AhKd", "7c5s2h", 2)
+		expect(job.wait(30)).to be true
+		expect(job.value[:equity]).to be_within(1e-12).of(pe.multiway_equity("AhKd", "7c5s2h", 2)[:equity])
+		job = pe.multiway_equity_async("AhKd", "7c5s2h", 4).cancel
+		expect(job.wait).to be true
+		expect(job).to be_cancelled
+		expect(job.value).to be_nil
+		job = pe.hand_potential_async("AhKd", "7c5s2hKcQd")
+		expect(job).to be_done
+		expect(job.value).to eq(pe.hand_potential("AhKd", "7c5s2hKcQd"))
+		expect(pe.hand_potential_async("AhKd", "7c5s2hKc", 6).value).to eq(pe.hand_potential("AhKd", "7c5s2hKc"))
+	end
+
+	it "Can get hand strength distributions" do
+		res = pe.hs_distribution("AhKd", "7c5s2hKc", 5)
+		expect(res[:runouts]).to eq(46)
+		rivers = PokerEval::RankChars.product(PokerEval::SuitChars).map(&:join) - %w{Ah Kd 7c 5s 2h Kc}
+		hs = rivers.map {|c| pe.hand_strength("AhKd", "7c5s2hKc" + c) }
+		expect(res[:ehs]).to be_within(1e-9).of(hs.sum / hs.length)
+		expect(res[:ehs2]).to be_within(1e-9).of(hs.map {|x| x * x }.sum / hs.length)
+		expect(res[:histogram].length).to eq(5)
+		expect(res[:histogram].sum).to be_within(1e-9).of(1)
+		expect(res[:histogram][4]).to be_within(1e-9).of(hs.count {|x| x >= 0.8 } / 46.0)
+		expect(pe.hs_distribution("AhKd", "7c5s2h")[:runouts]).to eq(1081)
+		expect(pe.hs_distribution("AhKd", "7c5s")).to be_nil
+	end
+
+	it "Can get outs" do
+		outs = pe.eval_outs("7s7c", "8h9dJs")
+		expect(outs.keys).to eq(["Turn", "River"])
+		expect(outs["Turn"]["Trips"]).to be_within(1e-9).of(2 / 47.0 * 100)
+		expect(outs["River"].values.inject(:+)).to be_within(1e-9).of(100)
+		expect(pe.outs("Td5s", "4h5h9cKd").length).to eq(28)
+		expect(pe.outs("Td5s", "4h5h9cKd")).to include("5c")
+	end
+
+	it "Can get equity by simulation" do
+		eq = pe.get_equity(pocket: "AsAc", iterations: 20000, seed: 1)
+		expect(eq).to be_within(0.02).of(0.852)
+		eq2 = pe.get_equity(pocket: "AsAc", iterations: 20000, seed: 1)
+		expect(eq2).to eq(eq)
+		eq = pe.get_equity(pocket: "AsAc", num_opponents: 2, iterations: 20000)
+		expect(eq).to be_within(0.02).of(0.735)
+	end
+
+	it "Can sample equity until it is accurate enough" do
+		exact = pe.multiway_equity("AhKd", "7c5s2h", 2)[:equity]
+		[false, true].each do |stratified|
+			est = pe.equity_estimate(pocket: "AhKd", board: "7c5s2h", num_opponents: 2, target_se: 0.005, stratified: stratified, seed: 1)
+			expect(est[:std_error]).to be <= 0.005
+			expect(est[:interval][0]).to be < est[:equity]
+			expect(est[:interval][1]).to be > est[:equity]
+			expect(est[:equity]).to be_within(0.02).of(exact)
+			expect(est[:samples]).to be < 1_000_000
+		end
+		est = pe.equity_estimate(pocket: "AhKd", num_opponents: 2, target_se: nil, deadline: 0.01)
+		expect(est[:samples]).to be > 0
+		expect(pe.get_equity(pocket: "AsAc", num_opponents: 2, target_se: 0.01)).to be_within(0.04).of(0.735)
+		est = pe.equity_estimate(pocket: "AhKd", board: "7c5s2h", target_se: nil, max_samples: 20, stratified: true, seed: 1)
+		expect(est[:samples]).to eq(20)
+		expect(pe.equity_estimate(pocket: "AsAc", num_opponents: 30)).to be_nil
+	end
+
+	it "Can deal random cards natively" do
+		dead = pe.get_cards("AsKd7c")
+		deck = PokerEval::Deck.new(dead, 1)
+		expect(deck.live).to eq(49)
+		layouts = deck.deal([2, 2, 2, 5], 1000)
+		expect(layouts.length).to eq(1000)
+		layouts.each do |sets|
+			expect(sets.map {|m| m.to_s(2).count("1") }).to eq([2, 2, 2, 5])
+			expect(sets.reduce(dead.cards_n) {|used, m| used & m == 0 ? used | m : -1 }).not_to eq(-1)
+		end
+		expect(PokerEval::Deck.new(dead, 1).deal([2, 2, 2, 5], 1000)).to eq(layouts)
+		expect { deck.deal([50]) }.to raise_error(ArgumentError)
+		n = 0
+		pe.montecarlo_sets([2, 1], dead, 3000) do |sets|
+			expect(sets.map(&:count)).to eq([2, 1])
+			expect(sets[0].any_set(sets[1]) || sets[0].any_set(dead)).to be false
+			n += 1
+		end
+		expect(n).to eq(3000)
+		kept = []
+		pe.montecarlo_sets([2], dead, 100, true) {|sets| kept << sets[0] }
+		expect(kept.map(&:cards_n).uniq.length).to be > 1
+		expect(pe.get_cards(pe.get_random_hand_not_in_str("AsKd")).any_set(pe.get_cards("AsKd"))).to be false
+	end
 end
 
 describe PokerEvalAPI do
@@ -110,4 +402,11 @@ describe PokerEvalAPI do
 		expect(type).to eq(6)
 	end
 
+	it "Can evaluate hands in a batch" do
+		hands = %w{9s9d9h4d4c AsKsQsJsTs 2c7d9hJsKd}.map {|h| PokerEvalAPI.TextToPokerEval(h) }
+		expect(PokerEvalAPI.eval_batch(hands)).to eq(hands.map {|h| h.eval(5) })
+		expect(PokerEvalAPI.eval_batch(hands.map(&:cards_n), [5, 5, 5])).to eq(hands.map {|h| h.eval(5) })
+		expect(PokerEvalAPI.eval_type_batch(hands)).to eq([6, 8, 0])
+	end
+
 end